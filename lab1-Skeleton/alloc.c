@@ -4,6 +4,7 @@
 
 #include <error.h>
 #include <errno.h>
+#include <stddef.h>
 #include <stdlib.h>
 
 static void
@@ -41,3 +42,95 @@ checked_grow_alloc (void *ptr, size_t *size)
     *size = *size < max / 2 ? 2 * *size : max;
     return checked_realloc (ptr, *size);
 }
+
+/* Arenas.  An arena hands out memory from a chain of blocks and frees it
+ all at once.  The arena itself lives at the front of its first block,
+ so an arena whose allocations fit in that block costs one malloc to
+ create and one free to destroy.  */
+
+enum { ARENA_FIRST_BLOCK_SIZE = 1024 };
+
+#define ARENA_ALIGNMENT _Alignof (max_align_t)
+
+struct arena_block
+{
+    struct arena_block *next;
+    size_t size;
+};
+
+struct arena
+{
+    // Blocks after the first one, most recent first.
+    struct arena_block *blocks;
+
+    // Free space in the current block.
+    char *next;
+    char *limit;
+
+    // Size of the most recently allocated block.
+    size_t block_size;
+};
+
+static size_t
+align_up (size_t n)
+{
+    return (n + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+struct arena *
+arena_create (void)
+{
+    size_t header = align_up (sizeof (struct arena));
+    char *block = checked_malloc (ARENA_FIRST_BLOCK_SIZE);
+    struct arena *a = (struct arena *) block;
+    a->blocks = NULL;
+    a->next = block + header;
+    a->limit = block + ARENA_FIRST_BLOCK_SIZE;
+    a->block_size = ARENA_FIRST_BLOCK_SIZE;
+    return a;
+}
+
+void *
+arena_alloc (struct arena *a, size_t size)
+{
+    size = align_up (size ? size : 1);
+
+    if ((size_t) (a->limit - a->next) < size)
+    {
+        // Start a new block, twice as big as the last one.
+        size_t header = align_up (sizeof (struct arena_block));
+        size_t block_size = a->block_size;
+        do
+        {
+            if (block_size > (size_t) -1 / 2)
+                memory_exhausted (0);
+            block_size *= 2;
+        }
+        while (block_size - header < size);
+
+        struct arena_block *b = checked_malloc (block_size);
+        b->next = a->blocks;
+        b->size = block_size;
+        a->blocks = b;
+        a->next = (char *) b + header;
+        a->limit = (char *) b + block_size;
+        a->block_size = block_size;
+    }
+
+    void *p = a->next;
+    a->next += size;
+    return p;
+}
+
+void
+arena_destroy (struct arena *a)
+{
+    struct arena_block *b = a->blocks;
+    while (b)
+    {
+        struct arena_block *next = b->next;
+        free (b);
+        b = next;
+    }
+    free (a);
+}
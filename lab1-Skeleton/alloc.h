@@ -3,3 +3,9 @@
 void *checked_malloc (size_t);
 void *checked_realloc (void *, size_t);
 void *checked_grow_alloc (void *, size_t *);
+
+/* Arenas: allocate many objects, then free them all at once.  */
+struct arena;
+struct arena *arena_create (void);
+void *arena_alloc (struct arena *, size_t);
+void arena_destroy (struct arena *);
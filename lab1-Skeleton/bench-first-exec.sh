@@ -0,0 +1,40 @@
+#! /bin/sh
+
+# UCLA CS 111 Lab 1 - Measure how long a large script takes to start
+# running its first command.
+
+trees=${TREES-200000}
+
+tmp=$0-$$.tmp
+mkdir "$tmp" || exit
+(
+cd "$tmp" || exit
+
+# The first tree records when it runs; the rest only make the script big.
+{
+  echo 'date +%s%N >started'
+  awk -v n="$trees" 'BEGIN {
+    for (i = 0; i < n; i++)
+      printf "\ncat <in%d | tr a-z A-Z >out%d || echo failed %d\n", i, i, i
+  }'
+} >big.sh || exit
+
+start=$(date +%s%N)
+../timetrash big.sh >/dev/null 2>&1 &
+pid=$!
+while test ! -s started; do
+  kill -0 $pid 2>/dev/null || break
+done
+end=$(cat started 2>/dev/null)
+kill $pid 2>/dev/null
+wait $pid 2>/dev/null
+
+test -n "$end" || {
+  echo >&2 "$0: first command never ran"
+  exit 1
+}
+echo "time to first exec, $trees trees ($(wc -c <big.sh) bytes):" \
+  "$(( (end - start) / 1000000 )) ms"
+) || exit
+
+rm -fr "$tmp"
@@ -0,0 +1,42 @@
+#! /bin/sh
+
+# UCLA CS 111 Lab 1 - Measure how fast scripts are parsed into trees.
+
+trees=${TREES-100000}
+runs=${RUNS-5}
+
+tmp=$0-$$.tmp
+mkdir "$tmp" || exit
+(
+cd "$tmp" || exit
+
+# Many small trees, each with a few operators, a subshell and redirections,
+# so the time goes to building trees rather than to scanning long words.
+awk -v n="$trees" 'BEGIN {
+  for (i = 0; i < n; i++)
+    printf "a%d b <c >d && (e | f g ; h) || i j k | l >m\n\n", i
+}' >parse.sh || exit
+
+# Report the fastest of several runs, which is the one least disturbed
+# by whatever else the machine is doing.
+best_time () {
+  best=
+  i=0
+  while test $i -lt "$runs"; do
+    start=$(date +%s%N)
+    ../timetrash "$@" >/dev/null || exit
+    end=$(date +%s%N)
+    ms=$(( (end - start) / 1000000 ))
+    test -n "$best" && test "$best" -le $ms || best=$ms
+    i=$((i + 1))
+  done
+  echo "$best ms (best of $runs)"
+}
+
+# -p runs nothing; -n does not even build trees.
+echo "$trees trees ($(wc -c <parse.sh) bytes):"
+echo "  parse and print: $(best_time -p parse.sh)"
+echo "  check syntax:    $(best_time -n parse.sh)"
+) || exit
+
+rm -fr "$tmp"
@@ -0,0 +1,59 @@
+#! /bin/sh
+
+# UCLA CS 111 Lab 1 - Measure how fast simple commands are started, with
+# posix_spawn and with the fork that TIMETRASH_FORK asks for instead.
+
+spawns=${SPAWNS-2000}
+pad=${PAD-300000}
+runs=${RUNS-3}
+
+for true_path in /bin/true /usr/bin/true; do
+  test -x "$true_path" && break
+done
+
+tmp=$0-$$.tmp
+mkdir "$tmp" || exit
+(
+cd "$tmp" || exit
+
+# A tree of nothing but commands to start.
+awk -v n="$spawns" -v cmd="$true_path" 'BEGIN {
+  for (i = 0; i < n; i++)
+    print cmd
+}' >small.sh || exit
+
+# The same commands, in a tree that also holds a big subshell that never
+# runs, so the shell has a lot of memory for fork to copy.
+awk -v n="$spawns" -v pad="$pad" -v cmd="$true_path" 'BEGIN {
+  printf "false && ("
+  for (i = 0; i < pad; i++)
+    printf "a%d b <c >d ; ", i
+  print "e)"
+  for (i = 0; i < n; i++)
+    print cmd
+}' >large.sh || exit
+
+# Report the best rate of several runs.
+rate () {
+  best=
+  i=0
+  while test $i -lt "$runs"; do
+    start=$(date +%s%N)
+    "$@" >/dev/null || exit
+    end=$(date +%s%N)
+    ms=$(( (end - start) / 1000000 ))
+    test -n "$best" && test "$best" -le $ms || best=$ms
+    i=$((i + 1))
+  done
+  echo "$(( spawns * 1000 / (best ? best : 1) )) spawns/s (best of $runs)"
+}
+
+echo "$spawns commands, alone:"
+echo "  posix_spawn: $(rate ../timetrash small.sh)"
+echo "  fork:        $(rate env TIMETRASH_FORK=1 ../timetrash small.sh)"
+echo "$spawns commands, in a tree of $pad more:"
+echo "  posix_spawn: $(rate ../timetrash large.sh)"
+echo "  fork:        $(rate env TIMETRASH_FORK=1 ../timetrash large.sh)"
+) || exit
+
+rm -fr "$tmp"
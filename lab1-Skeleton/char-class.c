@@ -0,0 +1,207 @@
+// UCLA CS 111 Lab 1 character classification
+
+#include "char-class.h"
+
+#if defined __x86_64__ || defined __i386__
+# include <immintrin.h>
+#endif
+
+#define R REGULAR_CHAR
+#define T TOKEN_CHAR
+#define N NEWLINE_CHAR
+#define H HASHTAG_CHAR
+#define W WHITESPACE_CHAR
+#define I INVALID_CHAR
+
+/* Words are made of letters, digits and ! % + , - . / : @ ^ _.
+ Only ' ' counts as whitespace.  */
+unsigned char const char_classes[256] = {
+    I, I, I, I, I, I, I, I, I, I, N, I, I, I, I, I,  /* 00 */
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  /* 10 */
+    W, R, I, H, I, R, T, I, T, T, I, R, R, R, R, R,  /* 20 */
+    R, R, R, R, R, R, R, R, R, R, R, T, T, I, T, I,  /* 30 */
+    R, R, R, R, R, R, R, R, R, R, R, R, R, R, R, R,  /* 40 */
+    R, R, R, R, R, R, R, R, R, R, R, I, I, I, R, R,  /* 50 */
+    I, R, R, R, R, R, R, R, R, R, R, R, R, R, R, R,  /* 60 */
+    R, R, R, R, R, R, R, R, R, R, R, I, T, I, I, I,  /* 70 */
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  /* 80 */
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  /* 90 */
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  /* a0 */
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  /* b0 */
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  /* c0 */
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  /* d0 */
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  /* e0 */
+    I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  /* f0 */
+};
+
+#undef R
+#undef T
+#undef N
+#undef H
+#undef W
+#undef I
+
+static char const *
+skip_class_scalar (char const *p, char const *end, enum char_type type)
+{
+    while (p < end && identify_char_type (*p) == type)
+        p++;
+    return p;
+}
+
+static char const *
+skip_word_chars_scalar (char const *p, char const *end)
+{
+    return skip_class_scalar (p, end, REGULAR_CHAR);
+}
+
+static char const *
+skip_spaces_scalar (char const *p, char const *end)
+{
+    return skip_class_scalar (p, end, WHITESPACE_CHAR);
+}
+
+#ifdef __SSE2__
+
+/* The word characters fall in the ranges [+-:] (which holds + , - . /
+ 0-9 :), [@-Z], [^_] and [a-z], plus '!' and '%'.  Bytes of 0x80 and up
+ compare as negative, so they fail every range test.  */
+
+static inline __m128i
+in_range_sse2 (__m128i x, char lo, char hi)
+{
+    return _mm_and_si128 (_mm_cmpgt_epi8 (x, _mm_set1_epi8 (lo - 1)),
+                          _mm_cmplt_epi8 (x, _mm_set1_epi8 (hi + 1)));
+}
+
+static inline unsigned
+word_mask_sse2 (__m128i x)
+{
+    __m128i m = _mm_or_si128 (in_range_sse2 (x, '+', ':'),
+                              in_range_sse2 (x, '@', 'Z'));
+    m = _mm_or_si128 (m, in_range_sse2 (x, '^', '_'));
+    m = _mm_or_si128 (m, in_range_sse2 (x, 'a', 'z'));
+    m = _mm_or_si128 (m, _mm_cmpeq_epi8 (x, _mm_set1_epi8 ('!')));
+    m = _mm_or_si128 (m, _mm_cmpeq_epi8 (x, _mm_set1_epi8 ('%')));
+    return _mm_movemask_epi8 (m);
+}
+
+static char const *
+skip_word_chars_sse2 (char const *p, char const *end)
+{
+    for (; end - p >= 16; p += 16)
+    {
+        unsigned mask = word_mask_sse2 (_mm_loadu_si128 ((__m128i const *) p));
+        if (mask != 0xffff)
+            return p + __builtin_ctz (~mask);
+    }
+    return skip_word_chars_scalar (p, end);
+}
+
+static char const *
+skip_spaces_sse2 (char const *p, char const *end)
+{
+    __m128i space = _mm_set1_epi8 (' ');
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i x = _mm_loadu_si128 ((__m128i const *) p);
+        unsigned mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (x, space));
+        if (mask != 0xffff)
+            return p + __builtin_ctz (~mask);
+    }
+    return skip_spaces_scalar (p, end);
+}
+
+__attribute__ ((target ("avx2"))) static inline __m256i
+in_range_avx2 (__m256i x, char lo, char hi)
+{
+    return _mm256_and_si256 (_mm256_cmpgt_epi8 (x, _mm256_set1_epi8 (lo - 1)),
+                             _mm256_cmpgt_epi8 (_mm256_set1_epi8 (hi + 1), x));
+}
+
+__attribute__ ((target ("avx2"))) static char const *
+skip_word_chars_avx2 (char const *p, char const *end)
+{
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i x = _mm256_loadu_si256 ((__m256i const *) p);
+        __m256i m = _mm256_or_si256 (in_range_avx2 (x, '+', ':'),
+                                     in_range_avx2 (x, '@', 'Z'));
+        m = _mm256_or_si256 (m, in_range_avx2 (x, '^', '_'));
+        m = _mm256_or_si256 (m, in_range_avx2 (x, 'a', 'z'));
+        m = _mm256_or_si256 (m, _mm256_cmpeq_epi8 (x, _mm256_set1_epi8 ('!')));
+        m = _mm256_or_si256 (m, _mm256_cmpeq_epi8 (x, _mm256_set1_epi8 ('%')));
+        unsigned mask = _mm256_movemask_epi8 (m);
+        if (mask != 0xffffffff)
+            return p + __builtin_ctz (~mask);
+    }
+    return skip_word_chars_sse2 (p, end);
+}
+
+__attribute__ ((target ("avx2"))) static char const *
+skip_spaces_avx2 (char const *p, char const *end)
+{
+    __m256i space = _mm256_set1_epi8 (' ');
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i x = _mm256_loadu_si256 ((__m256i const *) p);
+        unsigned mask = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (x, space));
+        if (mask != 0xffffffff)
+            return p + __builtin_ctz (~mask);
+    }
+    return skip_spaces_sse2 (p, end);
+}
+
+#endif
+
+static char const *(*word_scanner) (char const *, char const *)
+  = skip_word_chars_scalar;
+static char const *(*space_scanner) (char const *, char const *)
+  = skip_spaces_scalar;
+
+/* Pick the widest scanners this CPU supports, once, before main runs.  */
+__attribute__ ((constructor)) static void
+select_scanners (void)
+{
+#ifdef __SSE2__
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2"))
+    {
+        word_scanner = skip_word_chars_avx2;
+        space_scanner = skip_spaces_avx2;
+    }
+    else
+    {
+        word_scanner = skip_word_chars_sse2;
+        space_scanner = skip_spaces_sse2;
+    }
+#endif
+}
+
+/* Most words are a few bytes long and most runs of spaces are one space,
+ so the scanners look at this many bytes one at a time before paying for
+ a vector scan.  */
+enum { SHORT_RUN = 8 };
+
+static inline char const *
+skip_class (char const *p, char const *end, enum char_type type,
+            char const *(*scanner) (char const *, char const *))
+{
+    char const *stop = end - p < SHORT_RUN ? end : p + SHORT_RUN;
+    for (; p < stop; p++)
+        if (identify_char_type (*p) != type)
+            return p;
+    return p == end ? p : scanner (p, end);
+}
+
+char const *
+skip_word_chars (char const *p, char const *end)
+{
+    return skip_class (p, end, REGULAR_CHAR, word_scanner);
+}
+
+char const *
+skip_spaces (char const *p, char const *end)
+{
+    return skip_class (p, end, WHITESPACE_CHAR, space_scanner);
+}
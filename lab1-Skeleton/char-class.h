@@ -0,0 +1,29 @@
+// UCLA CS 111 Lab 1 character classification
+#include <stddef.h>
+
+enum char_type
+{
+    REGULAR_CHAR,           //0
+    TOKEN_CHAR,             //1
+    NEWLINE_CHAR,           //2
+    HASHTAG_CHAR,           //3
+    WHITESPACE_CHAR,        //4
+    INVALID_CHAR,           //5
+};
+
+/* The class of each byte value, indexed by unsigned char.  */
+extern unsigned char const char_classes[256];
+
+static inline enum char_type
+identify_char_type (char character)
+{
+    return char_classes[(unsigned char) character];
+}
+
+/* Return the first byte in [P, END) that is not a word character
+ (REGULAR_CHAR), or END if there is none.  Runs longer than a few bytes
+ are scanned with AVX2 or SSE2 when the CPU has them.  */
+char const *skip_word_chars (char const *p, char const *end);
+
+/* Likewise for runs of whitespace.  */
+char const *skip_spaces (char const *p, char const *end);
@@ -1,4 +1,6 @@
 // UCLA CS 111 Lab 1 command internals
+#include <stddef.h>
+#include <stdint.h>
 
 enum command_type
 {
@@ -8,35 +10,91 @@ enum command_type
     PIPE_COMMAND,        // A | B
     SIMPLE_COMMAND,      // a simple command
     SUBSHELL_COMMAND,    // ( A )
-    SUBSHELL_OPEN,
-    SUBSHELL_CLOSED,
+    BACKGROUND_COMMAND,  // A &
 };
 
-// Data associated with a command.
+/* A command tree.  Its nodes live in parallel arrays indexed by 32-bit
+ node numbers, children numbered before their parents, so walking a tree
+ walks a few contiguous arrays instead of chasing pointers.  Every node
+ is part of the tree, so the root is the last node.  The tree, its
+ arrays and any copied words are a single allocation.
+
+ A finished stream keeps one copy of each distinct tree, shared by every
+ commandNode it appears in; what belongs to one appearance (its number,
+ dependencies and progress) is kept in the commandNode.  */
 struct command
 {
-    enum command_type type;
-    
-    // Exit status, or -1 if not known (e.g., because it has not exited yet).
+    // Exit status of the whole tree, or -1 if not known (e.g., because it
+    // has not exited yet).
     int status;
     
-    // I/O redirections, or 0 if none.
-    char *input;
-    char *output;
-    
+    // The number of the tree, or of its first appearance if it is shared.
     int tree_number;
     
-    union
-    {
-        // for AND_COMMAND, SEQUENCE_COMMAND, OR_COMMAND, PIPE_COMMAND:
-        struct command *command[2];
-        
-        // for SIMPLE_COMMAND:
-        char **word;
-        
-        // for SUBSHELL_COMMAND:
-        struct command *subshell_command;
-    } u;
+    // How many holders the tree has; free_command frees it with the last.
+    uint32_t refs;
+    
+    // The node that is the whole command, and the number of nodes.
+    uint32_t root;
+    uint32_t num_nodes;
+    
+    // For each node: its enum command_type, and its I/O redirections as
+    // indices in WORD, or 0 if none.
+    unsigned char *type;
+    uint32_t *input;
+    uint32_t *output;
+    
+    // For each node:
+    // AND_COMMAND, SEQUENCE_COMMAND, OR_COMMAND, PIPE_COMMAND: the two
+    // operand nodes.
+    // SUBSHELL_COMMAND, BACKGROUND_COMMAND: the body node, in child[n][0].
+    // SIMPLE_COMMAND: the index in WORD of the first word, in child[n][0];
+    // the words end with a null pointer.
+    uint32_t (*child)[2];
+    
+    // Every word and file name in the tree.  word[0] is a null pointer, so
+    // word[input[n]] and word[output[n]] are null when there is no
+    // redirection.
+    char **word;
+    
+    // For time travel, the arena holding the tree's read and write lists;
+    // 0 until they are made.
+    struct arena *arena;
 };
 
+/* Allocate a tree with NUM_NODES nodes and NUM_WORDS entries in WORD
+ (counting word[0] and the null pointer after each simple command's
+ words), followed by TEXT_SIZE bytes for copies of words, which *TEXT is
+ set to point to.  Only word[0] is filled in; ROOT is the last node.
+ free_command releases it all.  */
+struct command *alloc_command_tree (uint32_t num_nodes, uint32_t num_words,
+                                    size_t text_size, char **text);
 
+// The files a tree reads or writes, for working out which trees depend on
+// which.  File names are interned, so comparing two of them is comparing
+// ids.
+struct wnode
+{
+    int file_id;
+    struct wnode *next, *prev;
+};
+
+struct write_list
+{
+    struct wnode *head, *tail;
+    struct wnode *current;
+    struct arena *arena;
+};
+
+struct rnode
+{
+    int file_id;
+    struct rnode *next, *prev;
+};
+
+struct read_list
+{
+    struct rnode *head, *tail;
+    struct rnode *current;
+    struct arena *arena;
+};
@@ -1,11 +1,14 @@
 // UCLA CS 111 Lab 1 command interface
 
+#include <stddef.h>
+
 typedef enum { false, true } bool;
 
 typedef struct command *command_t;
 typedef struct commandNode *commandNode_t;
 typedef struct command_stream *command_stream_t;
-typedef struct commandStack *commandStack_t;
+
+struct arena;
 
 typedef struct wnode *wnode_t;
 typedef struct write_list *write_list_t;
@@ -32,19 +35,84 @@ struct command_stream {
     commandNode_t current;
     int num_nodes;
     commandNode_t* blocked_commands;
-    
+    //the part of the script not parsed yet, or NULL once it is all parsed
+    struct command_reader *reader;
 };
 
+/* Create an empty command stream, a node holding the tree rooted at
+ COMMAND, and append NODE to STREAM.  The parser builds its streams with
+ these, and so can anything else that has trees to hand out, such as the
+ script cache.  */
+command_stream_t initStream (void);
+commandNode_t createNodeFromCommand (command_t command);
+void addNodeToStream (command_stream_t stream, commandNode_t node);
+
 /* Create a command stream from LABEL, GETBYTE, and ARG.  A reader of
  the command stream will invoke GETBYTE (ARG) to get the next byte.
  GETBYTE will return the next input byte, or a negative number
- (setting errno) on failure.  */
+ (setting errno) on failure.  Bytes are read as commands are parsed, and
+ only enough of them to hold the command being parsed are kept, so the
+ stream's memory does not grow with the length of the script.  */
 command_stream_t make_command_stream (int (*getbyte) (void *), void *arg);
 
+/* Like make_command_stream, but read the script from the file descriptor
+ FD (a pipe, say) in large read calls instead of a byte at a time.  FD is
+ read only as the stream is parsed, and is not closed.  */
+command_stream_t make_command_stream_from_fd (int fd);
+
+/* Create a command stream from the SIZE bytes at SCRIPT.  The lexer
+ scans SCRIPT in place, so this avoids a call through GETBYTE for every
+ byte of input.  SCRIPT must stay valid until the stream is exhausted.  */
+command_stream_t make_command_stream_from_buffer (char const *script, size_t size);
+
+/* Like make_command_stream_from_buffer, but without copying any words:
+ the words and file names in the trees point into SCRIPT, and each is
+ ended by overwriting the byte after it with '\0' once the lexer is done
+ with that byte.  SCRIPT[SIZE] must be a writable '\0'.  SCRIPT must
+ outlive every tree read from the stream.  */
+command_stream_t make_command_stream_in_place (char *script, size_t size);
+
+/* Check the syntax of the SIZE bytes at SCRIPT, read from the file
+ SCRIPT_NAME, without building any trees or allocating any memory.
+ Report each syntax error on stderr as "SCRIPT_NAME:LINE: message",
+ skipping from each to the next blank line, and return the number of
+ errors.  */
+int check_command_syntax (char const *script_name, char const *script,
+                          size_t size);
+
 /* Read a command from STREAM; return it, or NULL on EOF.  If there is
- an error, report the error and exit instead of returning.  */
+ an error, report the error and exit instead of returning.  Commands are
+ parsed on demand, so a syntax error is reported only when the command
+ containing it is reached.  */
 command_t read_command_stream (command_stream_t stream);
 
+/* Return how many bytes at the start of the script STREAM was made from
+ have been parsed into trees already read, or 0 if STREAM was made by
+ make_command_stream or has reached its end.  Once those trees are freed,
+ nothing looks at those bytes again.  */
+size_t command_stream_position (command_stream_t stream);
+
+/* Parse the rest of STREAM, adding every remaining tree (with its read
+ and write lists) to the stream's list.  Time travel needs all of the
+ trees before it can work out their dependencies.  A tree that is the
+ same as one already in the list, node for node and word for word, is
+ not kept twice: both nodes share the first tree and its lists, and
+ only the nodes' tree numbers differ.  */
+void finish_command_stream (command_stream_t stream);
+
+/* What optimize_command has removed so far.  */
+struct optimize_stats
+{
+    long nodes;     // tree nodes
+};
+
+/* Simplify a command before it runs, without changing what it does:
+ drop ":" and "true" on the left of ';', replace "true && X" and
+ "false || X" with X (unless X starts with a bare "exit", which reads
+ the status of the command dropped), and merge nested subshells when one
+ of them has no redirections.  Add what was removed to STATS.  */
+void optimize_command (command_t, struct optimize_stats *stats);
+
 /* Print a command to stdout, for debugging.  */
 void print_command (command_t);
 
@@ -59,13 +127,14 @@ void exec_time_travel(command_stream_t);
 int command_status (command_t);
 
 /* Create write or read lists for the root of each tree. We will use these for
- comparison in order to determine dependencies.  */
-write_list_t init_write_list();
-wnode_t create_wnode(char *file_name);
+ comparison in order to determine dependencies.  The lists are allocated
+ from ARENA, normally the tree's own.  */
+write_list_t init_write_list(struct arena *arena);
+wnode_t create_wnode(struct arena *arena, char *file_name);
 void add_wnode_to_list(wnode_t wnode, write_list_t write_list);
 write_list_t make_write_list(write_list_t w_list, command_t c);
-read_list_t init_read_list();
-rnode_t create_rnode(char *file_name);
+read_list_t init_read_list(struct arena *arena);
+rnode_t create_rnode(struct arena *arena, char *file_name);
 void add_rnode_to_list(rnode_t wnode, read_list_t read_list);
 read_list_t make_read_list(read_list_t r_list, command_t c);
 
@@ -78,7 +147,11 @@ bool WAW_dependency(write_list_t tree2_write_list, write_list_t tree1_write_list
 /* Makes dependency lists for each root.  */
 void make_dependency_lists (command_stream_t cstream);
 
-/* Allows time-travel during execution (i.e. parallelism).  */
+/* Allows time-travel during execution (i.e. parallelism).  CSTREAM must
+ already be finished and have its dependency lists made.  */
 void exec_time_travel(command_stream_t cstream);
 
+/* Release a tree returned by read_command_stream, and its read and write
+ lists.  A tree shared by several nodes of a finished stream is returned
+ once for each of them, and is freed when the last of those is released.  */
 void free_command(command_t);
\ No newline at end of file
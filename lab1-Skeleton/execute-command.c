@@ -1,6 +1,7 @@
 #include "command-internals.h"
 #include "command.h"
 #include "alloc.h"
+#include "intern.h"
 #include <unistd.h>
 #include <stdio.h>
 #include <ctype.h>
@@ -11,8 +12,11 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <spawn.h>
 #include <sys/wait.h>
 
+extern char **environ;
+
 /*
  Thoughts on how to implement time travel:
  
@@ -33,9 +37,246 @@
  
  */
 
+///////////////////////////////////////////////////////////////
+////////////////      COMMAND LOOKUP CODE     /////////////////
+///////////////////////////////////////////////////////////////
+
+//a directory named in $PATH, as it was when it was last looked at
+struct path_dir {
+    char *name;             //"." for an empty entry
+    bool exists;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    unsigned checked;       //the path_epoch it was last looked at in
+};
+
+//where a command name was found: PATH, in directory DIR, or NULL and the
+//number of directories if it is in none of them
+struct path_entry {
+    bool known;
+    char *path;
+    size_t dir;
+};
+
+//where each command name run so far was found on $PATH, so that the
+//directories are searched once per name instead of by every command run
+struct path_cache {
+    char *path_var;         //the $PATH the directories were taken from
+    struct path_dir *dirs;
+    size_t num_dirs;
+    struct path_entry *entries;     //by the intern id of the name
+    size_t size;            //bytes allocated for entries
+};
+
+static struct path_cache path_cache;
+
+//moved on whenever a command this shell started finishes or cd runs,
+//since either may have changed a directory on $PATH (or, for a relative
+//one, which directory it is).  within one epoch the directories are
+//trusted as they were last seen, so a pipeline or a run of trees started
+//together costs no more lookups than one command
+static unsigned path_epoch = 1;
+
+static void forget_found_commands(void) {
+    size_t i;
+    for (i = 0; i < path_cache.size / sizeof(struct path_entry); i++) {
+        free(path_cache.entries[i].path);
+        path_cache.entries[i].path = NULL;
+        path_cache.entries[i].known = false;
+    }
+}
+
+//look at directory D again, and return whether it has changed since the
+//last time (been created, removed, replaced or had an entry added or
+//removed, which changes its mtime)
+static bool path_dir_changed(struct path_dir *d) {
+    
+    struct stat st;
+    bool exists = stat(d->name, &st) == 0 && S_ISDIR(st.st_mode);
+    bool changed = exists != d->exists ||
+        (exists && (st.st_dev != d->dev || st.st_ino != d->ino ||
+                    st.st_mtim.tv_sec != d->mtime.tv_sec ||
+                    st.st_mtim.tv_nsec != d->mtime.tv_nsec));
+    
+    d->exists = exists;
+    if (exists) {
+        d->dev = st.st_dev;
+        d->ino = st.st_ino;
+        d->mtime = st.st_mtim;
+    }
+    d->checked = path_epoch;
+    return changed;
+}
+
+//look at the first COUNT directories, those not already looked at in this
+//epoch, and forget every name found if any of them has changed
+static void check_path_dirs(size_t count) {
+    
+    bool changed = false;
+    size_t i;
+    for (i = 0; i < count; i++) {
+        struct path_dir *d = &path_cache.dirs[i];
+        if (d->checked != path_epoch && path_dir_changed(d))
+            changed = true;
+    }
+    if (changed)
+        forget_found_commands();
+}
+
+//start over with the directories in PATH_VAR
+static void load_path_dirs(char const *path_var) {
+    
+    size_t i;
+    for (i = 0; i < path_cache.num_dirs; i++)
+        free(path_cache.dirs[i].name);
+    free(path_cache.dirs);
+    free(path_cache.path_var);
+    forget_found_commands();
+    
+    path_cache.path_var = checked_malloc(strlen(path_var) + 1);
+    strcpy(path_cache.path_var, path_var);
+    
+    size_t num_dirs = 1;
+    char const *p;
+    for (p = path_var; *p != '\0'; p++)
+        num_dirs += *p == ':';
+    path_cache.dirs = checked_malloc(num_dirs * sizeof(struct path_dir));
+    path_cache.num_dirs = num_dirs;
+    
+    p = path_var;
+    for (i = 0; i < num_dirs; i++) {
+        size_t length = strcspn(p, ":");
+        struct path_dir *d = &path_cache.dirs[i];
+        d->name = checked_malloc(length + 2);
+        if (length == 0)
+            strcpy(d->name, ".");
+        else {
+            memcpy(d->name, p, length);
+            d->name[length] = '\0';
+        }
+        path_dir_changed(d);
+        p += length + 1;
+    }
+}
+
+//return the file the command NAME runs, as execvp would find it, or NULL
+//if there is no such command.  a name with a '/' in it is the file itself
+static char const *find_command(char const *name) {
+    
+    if (strchr(name, '/') != NULL)
+        return name;
+    
+    char const *path_var = getenv("PATH");
+    if (path_var == NULL)
+        path_var = "/bin:/usr/bin";
+    if (path_cache.path_var == NULL || strcmp(path_var, path_cache.path_var) != 0)
+        load_path_dirs(path_var);
+    
+    int id = intern_string(name, strlen(name));
+    if (path_cache.size == 0) {
+        path_cache.size = 64 * sizeof(struct path_entry);
+        path_cache.entries = checked_malloc(path_cache.size);
+        memset(path_cache.entries, 0, path_cache.size);
+    }
+    while ((id + 1) * sizeof(struct path_entry) > path_cache.size) {
+        size_t old_size = path_cache.size;
+        path_cache.entries = checked_grow_alloc(path_cache.entries, &path_cache.size);
+        memset((char *) path_cache.entries + old_size, 0, path_cache.size - old_size);
+    }
+    struct path_entry *e = &path_cache.entries[id];
+    
+    //it is still there if neither its directory nor one searched before it
+    //has changed
+    if (e->known) {
+        check_path_dirs(e->dir < path_cache.num_dirs ? e->dir + 1 : path_cache.num_dirs);
+        if (e->known)
+            return e->path;
+    }
+    
+    check_path_dirs(path_cache.num_dirs);
+    e->known = true;
+    e->path = NULL;
+    e->dir = path_cache.num_dirs;
+    
+    size_t i;
+    for (i = 0; i < path_cache.num_dirs; i++) {
+        struct path_dir *d = &path_cache.dirs[i];
+        if (!d->exists)
+            continue;
+        
+        char *path = checked_malloc(strlen(d->name) + strlen(name) + 2);
+        sprintf(path, "%s/%s", d->name, name);
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0) {
+            e->path = path;
+            e->dir = i;
+            break;
+        }
+        free(path);
+    }
+    return e->path;
+}
+
+///////////////////////////////////////////////////////////////
+////////////////   BACKGROUND COMMAND CODE    /////////////////
+///////////////////////////////////////////////////////////////
+
+//the commands started with '&' by this process and not yet waited for
+struct background_jobs {
+    pid_t *pids;
+    size_t count;
+    size_t size;            //bytes allocated for pids
+};
+
+static struct background_jobs background_jobs;
+
+//forget the jobs that have finished, so they do not pile up as zombies
+//in a long script that never says wait
+static void reap_background_jobs(void) {
+    size_t kept = 0;
+    size_t i;
+    for (i = 0; i < background_jobs.count; i++) {
+        pid_t pid = background_jobs.pids[i];
+        if (waitpid(pid, NULL, WNOHANG) == 0)
+            background_jobs.pids[kept++] = pid;
+    }
+    if (kept < background_jobs.count)
+        path_epoch++;
+    background_jobs.count = kept;
+}
+
+static void add_background_job(pid_t pid) {
+    if (background_jobs.size == 0) {
+        background_jobs.size = 16 * sizeof(pid_t);
+        background_jobs.pids = checked_malloc(background_jobs.size);
+    }
+    if ((background_jobs.count + 1) * sizeof(pid_t) > background_jobs.size)
+        background_jobs.pids = checked_grow_alloc(background_jobs.pids, &background_jobs.size);
+    background_jobs.pids[background_jobs.count++] = pid;
+}
+
+//the wait builtin: block until every command started with '&' is done
+static void wait_for_background_jobs(void) {
+    size_t i;
+    for (i = 0; i < background_jobs.count; i++) {
+        while (waitpid(background_jobs.pids[i], NULL, 0) == -1 && errno == EINTR)
+            continue;
+    }
+    background_jobs.count = 0;
+    path_epoch++;
+}
+
+//a forked child starts out with no jobs of its own
+static void forget_background_jobs(void) {
+    background_jobs.count = 0;
+}
+
+//a command is not finished until everything it started with '&' is
 int
 command_status (command_t c)
 {
+    wait_for_background_jobs();
     return c->status;
 }
 
@@ -43,28 +284,18 @@ command_status (command_t c)
 //////////////////   WRITE NODE CODE    ///////////////////////
 ///////////////////////////////////////////////////////////////
 
-struct wnode {
-    char* file_name;
-    wnode_t next, prev;
-};
-
-
-struct write_list {
-    wnode_t head, tail;
-    wnode_t current;
-};
-
-write_list_t init_write_list(){
-    write_list_t new_write_list = (write_list_t) checked_malloc(sizeof(struct write_list));
+write_list_t init_write_list(struct arena *arena){
+    write_list_t new_write_list = (write_list_t) arena_alloc(arena, sizeof(struct write_list));
+    new_write_list->arena = arena;
     new_write_list->head = NULL;
     new_write_list->tail = NULL;
     new_write_list->current = NULL;
     return new_write_list;
 }
 
-wnode_t create_wnode(char *file_name){
-    wnode_t x = (wnode_t) checked_malloc(sizeof(*x));
-    x->file_name = file_name;
+wnode_t create_wnode(struct arena *arena, char *file_name){
+    wnode_t x = (wnode_t) arena_alloc(arena, sizeof(*x));
+    x->file_id = intern_string(file_name, strlen(file_name));
     x->prev = NULL;
     x->next = NULL;
     return x;
@@ -91,29 +322,14 @@ write_list_t make_write_list(write_list_t w_list, command_t c){
         return NULL;
     }
     
-    //if c->output is not NULL, there is a write, add it
-    if (c->output){
-        wnode_t new_write = create_wnode(c->output);
-        add_wnode_to_list(new_write, w_list);
-    }
-    
-    switch (c->type) {
-        case AND_COMMAND:
-        case SEQUENCE_COMMAND:
-        case OR_COMMAND:
-        case PIPE_COMMAND: {
-            make_write_list(w_list, c->u.command[0]);
-            make_write_list(w_list, c->u.command[1]);
-            break;
+    //every node's output is a write; the nodes are all in one array, so
+    //there is no need to walk the tree
+    uint32_t n;
+    for (n = 0; n < c->num_nodes; n++) {
+        if (c->output[n]){
+            wnode_t new_write = create_wnode(w_list->arena, c->word[c->output[n]]);
+            add_wnode_to_list(new_write, w_list);
         }
-        case SIMPLE_COMMAND:
-            break;
-        case SUBSHELL_COMMAND: {
-            make_write_list(w_list, c->u.subshell_command);
-            break;
-        }
-        default:
-            break;
     }
     
     return w_list;
@@ -123,28 +339,18 @@ write_list_t make_write_list(write_list_t w_list, command_t c){
 ///////////////////   READ NODE CODE    ///////////////////////
 ///////////////////////////////////////////////////////////////
 
-struct rnode {
-    char* file_name;
-    rnode_t next, prev;
-};
-
-
-struct read_list {
-    rnode_t head, tail;
-    rnode_t current;
-};
-
-read_list_t init_read_list(){
-    read_list_t new_read_list = (read_list_t) checked_malloc(sizeof(struct read_list));
+read_list_t init_read_list(struct arena *arena){
+    read_list_t new_read_list = (read_list_t) arena_alloc(arena, sizeof(struct read_list));
+    new_read_list->arena = arena;
     new_read_list->head = NULL;
     new_read_list->tail = NULL;
     new_read_list->current = NULL;
     return new_read_list;
 }
 
-rnode_t create_rnode(char *file_name){
-    rnode_t x = (rnode_t) checked_malloc(sizeof(*x));
-    x->file_name = file_name;
+rnode_t create_rnode(struct arena *arena, char *file_name){
+    rnode_t x = (rnode_t) arena_alloc(arena, sizeof(*x));
+    x->file_id = intern_string(file_name, strlen(file_name));
     x->prev = NULL;
     x->next = NULL;
     return x;
@@ -170,39 +376,26 @@ read_list_t make_read_list(read_list_t r_list, command_t c){
         return NULL;
     }
     
-    //if c->input is not NULL, there is a read, add it
-    if (c->input){
-        rnode_t new_read = create_rnode(c->input);
-        add_rnode_to_list(new_read, r_list);
-    }
-    
-    
-    switch (c->type) {
-        case AND_COMMAND:
-        case SEQUENCE_COMMAND:
-        case OR_COMMAND:
-        case PIPE_COMMAND: {
-            make_read_list(r_list, c->u.command[0]);
-            make_read_list(r_list, c->u.command[1]);
-            break;
+    uint32_t n;
+    for (n = 0; n < c->num_nodes; n++) {
+        
+        //if the node has an input, there is a read, add it
+        if (c->input[n]){
+            rnode_t new_read = create_rnode(r_list->arena, c->word[c->input[n]]);
+            add_rnode_to_list(new_read, r_list);
         }
-        case SIMPLE_COMMAND: {
-            //check for arguments
+        
+        //the arguments of a simple command may be files it reads
+        if (c->type[n] == SIMPLE_COMMAND) {
+            char **word = &c->word[c->child[n][0]];
             int i = 1;
-            while (c->u.word[i] != NULL) {
+            while (word[i] != NULL) {
                 
-                rnode_t new_read = create_rnode(c->u.word[i]);
+                rnode_t new_read = create_rnode(r_list->arena, word[i]);
                 add_rnode_to_list(new_read, r_list);
                 i++;
             }
-            break;
         }
-        case SUBSHELL_COMMAND: {
-            make_read_list(r_list, c->u.subshell_command);
-            break;
-        }
-        default:
-            break;
     }
     
     return r_list;
@@ -220,7 +413,7 @@ bool compare_read_list (read_list_t read_list1, read_list_t read_list2){
     
     while (list1_curr_node != NULL){
         while (list2_curr_node != NULL){
-            if (list1_curr_node->file_name == list2_curr_node->file_name){
+            if (list1_curr_node->file_id == list2_curr_node->file_id){
                 return true;
             }
             
@@ -248,7 +441,7 @@ bool RAW_dependency(read_list_t tree2_read_list, write_list_t tree1_write_list){
     while (tree2_curr_node != NULL){
         tree1_curr_node = tree1_write_list->head;
         while (tree1_curr_node != NULL){
-            if (strcmp(tree2_curr_node->file_name, tree1_curr_node->file_name) == 0){
+            if (tree2_curr_node->file_id == tree1_curr_node->file_id){
                 return true;
             }
             
@@ -272,7 +465,7 @@ bool WAR_dependency(write_list_t tree2_write_list, read_list_t tree1_read_list){
     while (tree2_curr_node != NULL){
         tree1_curr_node = tree1_read_list->head;
         while (tree1_curr_node != NULL){
-            if (strcmp(tree2_curr_node->file_name, tree1_curr_node->file_name) == 0){
+            if (tree2_curr_node->file_id == tree1_curr_node->file_id){
                 return true;
             }
             
@@ -296,7 +489,7 @@ bool WAW_dependency(write_list_t tree2_write_list, write_list_t tree1_write_list
     while (tree1_curr_node != NULL){
         tree2_curr_node = tree1_write_list ->head;
         while (tree2_curr_node != NULL){
-            if (strcmp(tree1_curr_node->file_name, tree2_curr_node->file_name) == 0){
+            if (tree1_curr_node->file_id == tree2_curr_node->file_id){
                 return true;
             }
             
@@ -316,55 +509,39 @@ void make_dependency_lists (command_stream_t cstream){
         exit(1);
     }
     
-    commandNode_t curr_node = cstream->head;
-    commandNode_t to_be_compared = cstream->head->next;
+    //a tree's dependencies are gathered here and then copied to a list
+    //just long enough for them, so the lists hold only the dependencies
+    //there are, not a slot for every earlier tree
+    size_t size = 64 * sizeof(commandNode_t);
+    commandNode_t *found = checked_malloc(size);
     
-    int i=0;
-    
-    while (curr_node != NULL){
+    commandNode_t to_be_compared;
+    for (to_be_compared = cstream->head; to_be_compared != NULL; to_be_compared = to_be_compared->next){
+        
+        size_t num_found = 0;
+        commandNode_t curr_node;
         
-        while (to_be_compared != NULL){
+        for (curr_node = cstream->head; curr_node != to_be_compared; curr_node = curr_node->next){
             
             //check for read-after-write (RAW) dependency
             //check for write-after-read (WAR) dependency
             //check for waw dependency
-            if (RAW_dependency(to_be_compared->read_list, curr_node->write_list)){
-                i=0;
-                while (to_be_compared->dependency_list[i] != '\0'){
-                    i++;
-                }
-                to_be_compared->dependency_list[i] = curr_node;
-                to_be_compared = to_be_compared->next;
-                continue;
-            } else if (WAR_dependency(to_be_compared->write_list, curr_node->read_list)){
-                i=0;
-                while (to_be_compared->dependency_list[i] != '\0'){
-                    i++;
-                }
-                to_be_compared->dependency_list[i] = curr_node;
-                to_be_compared = to_be_compared->next;
-                
-                continue;
-            } else if (WAW_dependency(to_be_compared->write_list, curr_node->write_list)){
-                i=0;
-                while (to_be_compared->dependency_list[i] != '\0'){
-                    i++;
-                }
-                to_be_compared->dependency_list[i] = curr_node;
-                to_be_compared = to_be_compared->next;
-                continue;
+            if (RAW_dependency(to_be_compared->read_list, curr_node->write_list) ||
+                WAR_dependency(to_be_compared->write_list, curr_node->read_list) ||
+                WAW_dependency(to_be_compared->write_list, curr_node->write_list)){
+                
+                if ((num_found + 1) * sizeof(commandNode_t) > size)
+                    found = checked_grow_alloc(found, &size);
+                found[num_found++] = curr_node;
             }
-            
-            /* If we get here, no dependencies were encountered. */
-            to_be_compared = to_be_compared->next;
         }
         
-        curr_node = curr_node->next;
-        if (curr_node != NULL){
-            to_be_compared = curr_node->next;
-        }
+        to_be_compared->dependency_list = checked_realloc(to_be_compared->dependency_list, (num_found + 1) * sizeof(commandNode_t));
+        memcpy(to_be_compared->dependency_list, found, num_found * sizeof(commandNode_t));
+        to_be_compared->dependency_list[num_found] = NULL;
     }
     
+    free(found);
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -373,39 +550,42 @@ void make_dependency_lists (command_stream_t cstream){
 
 //check for inputs and outputs
 //if they exist, deal with them somehow
-void handle_IO(command_t c) {
+void handle_IO(command_t c, uint32_t n) {
+    
+    char *input = c->word[c->input[n]];
+    char *output = c->word[c->output[n]];
     
-    if (c->input != NULL) { //we have an input
+    if (input != NULL) { //we have an input
         
         int input_fd;
-        input_fd = open(c->input, O_RDONLY, 0666);
+        input_fd = open(input, O_RDONLY, 0666);
         if (input_fd < 0) {
-            fprintf(stderr, "%s: error opening input file\n", c->input);
+            fprintf(stderr, "%s: error opening input file\n", input);
             exit(1);
         }
         
         int dup_result = dup2(input_fd, 0);
         if (dup_result < 0) {
-            fprintf(stderr, "Error in dup2() for input %s!\n", c->input);
+            fprintf(stderr, "Error in dup2() for input %s!\n", input);
             exit(1);
         }
         
         close(input_fd);
     }
     
-    if (c->output != NULL) { //we have an input
+    if (output != NULL) { //we have an input
         
         int output_fd;
-        output_fd = open(c->output, O_CREAT | O_WRONLY | O_TRUNC, 0666);
+        output_fd = open(output, O_CREAT | O_WRONLY | O_TRUNC, 0666);
         
         if (output_fd < 0) {
-            fprintf(stderr, "%s: error opening output file", c->output);
+            fprintf(stderr, "%s: error opening output file", output);
             exit(1);
         }
         
         int dup_result = dup2(output_fd, 1);
         if (dup_result < 0) {
-            fprintf(stderr, "Error in dup2() for output %s\n", c->output);
+            fprintf(stderr, "Error in dup2() for output %s\n", output);
             exit(1);
         }
         
@@ -414,177 +594,719 @@ void handle_IO(command_t c) {
     
 }
 
-//what is time_travel?
-void
-execute_command (command_t c, int time_travel)
+//a node being run, and how far it has got
+struct exec_frame {
+    uint32_t node;
+    int stage;
+    int cwd;                //for a subshell, the directory it started in
+};
+
+//an explicit stack of the nodes being run, so deep trees (long chains of
+//&& or ;) cannot overflow the C stack
+struct exec_stack {
+    struct exec_frame *frames;
+    size_t depth;
+    size_t size;            //bytes allocated for frames
+};
+
+static void push_node(struct exec_stack *stack, uint32_t n) {
+    if ((stack->depth + 1) * sizeof(struct exec_frame) > stack->size)
+        stack->frames = checked_grow_alloc(stack->frames, &stack->size);
+
+    struct exec_frame *f = &stack->frames[stack->depth++];
+    f->node = n;
+    f->stage = 0;
+    f->cwd = -1;
+}
+
+//leave the subshell in frame F.  it runs in this process, so whatever cd
+//did inside it is undone here by going back to where it started
+static void leave_subshell(struct exec_frame *f) {
+    if (f->cwd >= 0) {
+        if (fchdir(f->cwd) == 0)
+            path_epoch++;
+        close(f->cwd);
+    }
+}
+
+//open a file named in a redirection without letting it leak into other
+//commands; say why not and return -1 if it cannot be opened
+static int open_redirection(char const *file_name, int flags, char const *what) {
+    int fd = open(file_name, flags | O_CLOEXEC, 0666);
+    if (fd < 0)
+        fprintf(stderr, "%s: error opening %s file\n", file_name, what);
+    return fd;
+}
+
+//the words that run the file PATH with /bin/sh, as execvp does for a file
+//the kernel cannot run (ENOEXEC), such as a script with no "#!" line.
+//WORD are the command's words.  the caller frees the array
+static char **script_words(char const *path, char **word) {
+    
+    size_t count = 1;
+    while (word[count - 1] != NULL)
+        count++;
+    
+    char **sh_word = checked_malloc((count + 1) * sizeof(char *));
+    sh_word[0] = "/bin/sh";
+    sh_word[1] = (char *) path;
+    memcpy(&sh_word[2], &word[1], (count - 1) * sizeof(char *));
+    return sh_word;
+}
+
+//start simple command N with posix_spawn, which does not copy this
+//process's page tables the way fork does (they get big once a big tree
+//is held), and return its pid, or -1 if it could not be started.  the
+//command's stdin and stdout are IN and OUT, or this process's own if they
+//are -1, unless it has redirections.  those are opened here and handed to
+//the command, so a bad file name is still told apart from a missing command
+static pid_t spawn_simple_command(command_t c, uint32_t n, int in, int out) {
+    
+    char *input = c->word[c->input[n]];
+    char *output = c->word[c->output[n]];
+    char **word = &c->word[c->child[n][0]];
+    int input_fd = -1;
+    int output_fd = -1;
+    pid_t pid = -1;
+    
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (in >= 0)
+        posix_spawn_file_actions_adddup2(&actions, in, 0);
+    if (out >= 0)
+        posix_spawn_file_actions_adddup2(&actions, out, 1);
+    
+    if (input != NULL && (input_fd = open_redirection(input, O_RDONLY, "input")) >= 0)
+        posix_spawn_file_actions_adddup2(&actions, input_fd, 0);
+    
+    if ((input == NULL || input_fd >= 0) && output != NULL &&
+        (output_fd = open_redirection(output, O_CREAT | O_WRONLY | O_TRUNC, "output")) >= 0)
+        posix_spawn_file_actions_adddup2(&actions, output_fd, 1);
+    
+    char const *path = NULL;
+    if ((input == NULL || input_fd >= 0) && (output == NULL || output_fd >= 0) &&
+        (path = find_command(word[0])) == NULL)
+        fprintf(stderr, "%s: command not found\n", word[0]);
+    
+    if (path != NULL) {
+        int error = posix_spawn(&pid, path, &actions, NULL, word, environ);
+        if (error == ENOEXEC) {
+            char **sh_word = script_words(path, word);
+            error = posix_spawn(&pid, "/bin/sh", &actions, NULL, sh_word, environ);
+            free(sh_word);
+        }
+        if (error == EAGAIN || error == ENOMEM) {
+            fprintf(stderr, "Error in fork()!");
+            exit(1);
+        } else if (error != 0) {
+            fprintf(stderr, "%s: command not found\n", word[0]);
+            pid = -1;
+        }
+    }
+    
+    posix_spawn_file_actions_destroy(&actions);
+    if (input_fd >= 0)
+        close(input_fd);
+    if (output_fd >= 0)
+        close(output_fd);
+    return pid;
+}
+
+//become the program in the file PATH, with WORD as its words.  a file the
+//kernel cannot run is run with /bin/sh, as execvp would.  return only if
+//neither works
+static void exec_command_file(char const *path, char **word) {
+    
+    execv(path, word);
+    if (errno == ENOEXEC) {
+        char **sh_word = script_words(path, word);
+        execv("/bin/sh", sh_word);
+        free(sh_word);
+    }
+}
+
+//start simple command N the old way, with fork and exec, and return its pid
+static pid_t fork_simple_command(command_t c, uint32_t n, int in, int out) {
+    
+    char **word = &c->word[c->child[n][0]];
+    char const *path = find_command(word[0]);
+    if (path == NULL) {
+        fprintf(stderr, "%s: command not found\n", word[0]);
+        return -1;
+    }
+    
+    pid_t pid = fork();
+    
+    if (pid == -1) { //error in fork()
+        fprintf(stderr, "Error in fork()!");
+        exit(1);
+    }
+    
+    else if (pid == 0) { //we are in the child process; execute simple command here
+        
+        if (in >= 0)
+            dup2(in, 0);
+        if (out >= 0)
+            dup2(out, 1);
+        handle_IO(c, n);
+        
+        exec_command_file(path, word);
+        
+        //error in finding file
+        fprintf(stderr, "%s: command not found\n", word[0]);
+        exit(1);
+    }
+    
+    return pid;
+}
+
+//whether simple commands are started with fork, as they once were, rather
+//than posix_spawn: 1 if TIMETRASH_FORK is set, so the two can be
+//compared, or -1 until that has been looked up
+static int launch_with_fork = -1;
+
+//start simple command N with IN and OUT as its stdin and stdout (-1 for
+//this process's own), and return its pid, or -1 if it could not be started
+static pid_t start_simple_command(command_t c, uint32_t n, int in, int out) {
+    
+    if (launch_with_fork < 0)
+        launch_with_fork = getenv("TIMETRASH_FORK") != NULL;
+    
+    if (launch_with_fork)
+        return fork_simple_command(c, n, in, out);
+    return spawn_simple_command(c, n, in, out);
+}
+
+//wait for the command started as PID and return its exit status, or -1 if
+//it did not exit.  a command that could not be started (PID -1) fails, as
+//if it had exited 1
+static int wait_for_command(pid_t pid) {
+    
+    if (pid < 0)
+        return 1;
+    
+    int status;
+    //wait for child to exit
+    while (-1 == waitpid(pid, &status, 0)){
+    }
+    path_epoch++;
+    
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    
+    return -1;
+}
+
+///////////////////////////BUILTINS////////////////////////////
+//  commands the shell runs itself, without starting a process //
+
+//each is given the command's words and the status of the command that
+//finished last (-1 if none is known), and returns its exit status
+struct builtin {
+    char const *name;
+    int (*run)(char **word, int last_status);
+};
+
+static int builtin_true(char **word, int last_status) {
+    return 0;
+}
+
+static int builtin_false(char **word, int last_status) {
+    return 1;
+}
+
+//like echo(1): the words, separated by spaces.  -n leaves off the newline;
+//-e and -E are accepted, though no word can hold a backslash to escape
+static int builtin_echo(char **word, int last_status) {
+    
+    bool newline = true;
+    word++;
+    for (; *word != NULL && (*word)[0] == '-' && (*word)[1] != '\0'; word++) {
+        char const *option = *word + 1;
+        if (option[strspn(option, "neE")] != '\0')
+            break;
+        if (strchr(option, 'n') != NULL)
+            newline = false;
+    }
+    
+    //write the whole line at once, straight to fd 1, which may be redirected
+    size_t length = 0;
+    char **w;
+    for (w = word; *w != NULL; w++)
+        length += strlen(*w) + 1;
+    char *line = checked_malloc(length + 1);
+    char *p = line;
+    for (w = word; *w != NULL; w++) {
+        if (w != word)
+            *p++ = ' ';
+        size_t size = strlen(*w);
+        memcpy(p, *w, size);
+        p += size;
+    }
+    if (newline)
+        *p++ = '\n';
+    
+    int status = 0;
+    char const *q = line;
+    while (q < p) {
+        ssize_t written = write(1, q, p - q);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0) {
+            fprintf(stderr, "echo: write error: %s\n", strerror(errno));
+            status = 1;
+            break;
+        }
+        q += written;
+    }
+    
+    free(line);
+    return status;
+}
+
+//change to the directory named, or to $HOME.  commands started later
+//inherit it
+static int builtin_cd(char **word, int last_status) {
+    
+    char const *dir = word[1];
+    if (dir == NULL) {
+        dir = getenv("HOME");
+        if (dir == NULL) {
+            fprintf(stderr, "cd: HOME not set\n");
+            return 1;
+        }
+    }
+    
+    if (chdir(dir) != 0) {
+        fprintf(stderr, "cd: %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+    path_epoch++;
+    return 0;
+}
+
+//the status of the command that finished last, across trees, as a bare
+//exit returns it.  forked copies of the shell start out with it
+static int shell_status = 0;
+
+//set by exit, until the executor has left the innermost subshell or, if
+//there is none, the whole tree and then the shell (or the copy of it
+//running a pipeline stage, a background command or a time travel tree)
+static bool exit_requested = false;
+
+//exit with the status given, or the status of the command that finished last
+static int builtin_exit(char **word, int last_status) {
+    
+    int status = last_status < 0 ? 0 : last_status;
+    if (word[1] != NULL) {
+        char *end;
+        errno = 0;
+        long n = strtol(word[1], &end, 10);
+        if (errno != 0 || end == word[1] || *end != '\0') {
+            fprintf(stderr, "exit: %s: numeric argument required\n", word[1]);
+            status = 2;
+        } else {
+            status = n & 0xff;
+        }
+    }
+    exit_requested = true;
+    return status;
+}
+
+//wait waits for the shell's children, so only the shell can run it
+static int builtin_wait(char **word, int last_status) {
+    wait_for_background_jobs();
+    return 0;
+}
+
+static struct builtin const builtins[] = {
+    { ":", builtin_true },
+    { "true", builtin_true },
+    { "false", builtin_false },
+    { "echo", builtin_echo },
+    { "cd", builtin_cd },
+    { "exit", builtin_exit },
+    { "wait", builtin_wait },
+};
+
+//the builtin that simple command N runs, or NULL if it runs a program
+static struct builtin const *find_builtin(command_t c, uint32_t n) {
+    
+    char const *name = c->word[c->child[n][0]];
+    size_t i;
+    for (i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+        if (strcmp(name, builtins[i].name) == 0)
+            return &builtins[i];
+    }
+    return NULL;
+}
+
+static bool is_builtin(command_t c, uint32_t n) {
+    return find_builtin(c, n) != NULL;
+}
+
+//run builtin B for simple command N in this process.  its redirections
+//are put in place over fds 0 and 1 for as long as it runs, and the
+//shell's own are put back afterwards
+static int run_builtin(struct builtin const *b, command_t c, uint32_t n, int last_status) {
+    
+    char *input = c->word[c->input[n]];
+    char *output = c->word[c->output[n]];
+    int saved_stdin = -1;
+    int saved_stdout = -1;
+    int status = 1;
+    
+    if (input != NULL) {
+        int fd = open_redirection(input, O_RDONLY, "input");
+        if (fd < 0)
+            return 1;
+        saved_stdin = fcntl(0, F_DUPFD_CLOEXEC, 3);
+        dup2(fd, 0);
+        close(fd);
+    }
+    
+    int fd = -1;
+    if (output != NULL)
+        fd = open_redirection(output, O_CREAT | O_WRONLY | O_TRUNC, "output");
+    
+    if (output == NULL || fd >= 0) {
+        if (fd >= 0) {
+            saved_stdout = fcntl(1, F_DUPFD_CLOEXEC, 3);
+            dup2(fd, 1);
+            close(fd);
+        }
+        status = b->run(&c->word[c->child[n][0]], last_status);
+    }
+    
+    if (saved_stdin >= 0) {
+        dup2(saved_stdin, 0);
+        close(saved_stdin);
+    }
+    if (saved_stdout >= 0) {
+        dup2(saved_stdout, 1);
+        close(saved_stdout);
+    }
+    return status;
+}
+
+//run simple command N, wait for it, and return its exit status.
+//LAST_STATUS is the status of the command that finished before it
+static int run_simple_command(command_t c, uint32_t n, int last_status) {
+    
+    struct builtin const *b = find_builtin(c, n);
+    if (b != NULL)
+        return run_builtin(b, c, n, last_status);
+    
+    return wait_for_command(start_simple_command(c, n, -1, -1));
+}
+
+//when all that a copy of the shell made to run node N has left to do is
+//run one program (N is a simple command, maybe inside subshells), become
+//that program with exec instead of starting it and waiting for it.
+//return if there is more to do than that
+static void exec_if_simple(command_t c, uint32_t n) {
+    
+    uint32_t body = n;
+    while (c->type[body] == SUBSHELL_COMMAND)
+        body = c->child[body][0];
+    if (c->type[body] != SIMPLE_COMMAND || is_builtin(c, body))
+        return;
+    
+    //the command gets the subshells' redirections, as in execute_node
+    for (; n != body; n = c->child[n][0]) {
+        if (c->input[n])
+            c->input[c->child[n][0]] = c->input[n];
+        if (c->output[n])
+            c->output[c->child[n][0]] = c->output[n];
+    }
+    
+    char **word = &c->word[c->child[body][0]];
+    handle_IO(c, body);
+    char const *path = find_command(word[0]);
+    if (path != NULL)
+        exec_command_file(path, word);
+    
+    fprintf(stderr, "%s: command not found\n", word[0]);
+    exit(1);
+}
+
+static int execute_node (command_t c, uint32_t n, int time_travel);
+
+//the stages of the pipeline at node N, left to right: the nodes under it
+//that are not pipes themselves.  STAGES is grown as needed
+static size_t find_pipeline_stages(command_t c, uint32_t n, uint32_t **stages, size_t *size) {
+    
+    size_t num_stages = 0;
+    
+    //walk down the left sides, then come back up taking the right sides;
+    //pipes nest to the left, so this finds the stages in order without
+    //recursing once per stage.  the right side can only be a pipe if the
+    //tree was built some other way, and then it is walked the same way
+    size_t pending_size = 16 * sizeof(uint32_t);
+    uint32_t *pending = checked_malloc(pending_size);
+    size_t num_pending = 0;
+    pending[num_pending++] = n;
+    
+    while (num_pending > 0) {
+        uint32_t p = pending[--num_pending];
+        while (c->type[p] == PIPE_COMMAND) {
+            if ((num_pending + 1) * sizeof(uint32_t) > pending_size)
+                pending = checked_grow_alloc(pending, &pending_size);
+            pending[num_pending++] = c->child[p][1];
+            p = c->child[p][0];
+        }
+        if ((num_stages + 1) * sizeof(uint32_t) > *size)
+            *stages = checked_grow_alloc(*stages, size);
+        (*stages)[num_stages++] = p;
+    }
+    
+    free(pending);
+    return num_stages;
+}
+
+//make a pipe whose ends are closed in any command that is exec'd, so
+//each command holds only the ends it was handed as its stdin and stdout
+static void make_pipe(int fildes[2]) {
+    if (pipe(fildes) == -1){
+        fprintf(stderr, "Cannot create pipe.");
+        exit(1);
+    }
+    fcntl(fildes[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fildes[1], F_SETFD, FD_CLOEXEC);
+}
+
+//start stage N of a pipeline with IN and OUT as its stdin and stdout (-1
+//for this process's own), and return its pid, or -1 if it could not be
+//started.  a simple command is started directly; anything else needs a
+//copy of the shell to run it, which also closes UNUSED, the read end
+//meant for the next stage, and which becomes the program itself if the
+//stage is a subshell around one
+static pid_t start_pipeline_stage(command_t c, uint32_t n, int in, int out, int unused, int time_travel) {
+    
+    if (c->type[n] == SIMPLE_COMMAND && !is_builtin(c, n))
+        return start_simple_command(c, n, in, out);
+    
+    pid_t pid = fork();
+    
+    if (pid == -1) {
+        fprintf(stderr, "Error in fork() for PIPE_COMMAND!");
+        exit(1);
+    } else if (pid == 0) {
+        
+        if (in >= 0) {
+            dup2(in, 0);
+            close(in);
+        }
+        if (out >= 0) {
+            dup2(out, 1);
+            close(out);
+        }
+        if (unused >= 0)
+            close(unused);
+        
+        forget_background_jobs();
+        exec_if_simple(c, n);
+        int exit_status = execute_node(c, n, time_travel);
+        exit(exit_status < 0 ? 1 : exit_status);
+    }
+    
+    return pid;
+}
+
+//run the pipeline at node N and return the exit status of its last stage.
+//every stage is started by this process, all at once, each reading from a
+//pipe filled by the stage before it; this process's own stdin and stdout
+//are left alone.  a pipe is made just before the stage that writes to it,
+//and this process closes its ends as soon as both stages have them, so it
+//never holds more than three pipe ends however long the pipeline is
+static int run_pipeline(command_t c, uint32_t n, int time_travel) {
+    
+    size_t size = 16 * sizeof(uint32_t);
+    uint32_t *stages = checked_malloc(size);
+    size_t num_stages = find_pipeline_stages(c, n, &stages, &size);
+    pid_t *pids = checked_malloc(num_stages * sizeof(pid_t));
+    
+    int in = -1;    //the read end of the pipe from the stage before
+    size_t i;
+    for (i = 0; i < num_stages; i++) {
+        
+        int fildes[2] = { -1, -1 };
+        if (i + 1 < num_stages)
+            make_pipe(fildes);
+        
+        pids[i] = start_pipeline_stage(c, stages[i], in, fildes[1], fildes[0], time_travel);
+        
+        if (in >= 0)
+            close(in);
+        if (fildes[1] >= 0)
+            close(fildes[1]);
+        in = fildes[0];
+    }
+    
+    int exit_status = -1;
+    for (i = 0; i < num_stages; i++)
+        exit_status = wait_for_command(pids[i]);
+    
+    free(pids);
+    free(stages);
+    return exit_status;
+}
+
+//run node N of tree C and return its exit status, or -1 if not known.
+//each operator node is visited once per stage: stage 0 starts its left
+//side, stage 1 sees the left side's status and may start the right side,
+//and the last stage passes the status on to its parent
+static int execute_node (command_t c, uint32_t n, int time_travel)
 {
     pid_t pid;
-    int fildes[2];
-    switch (c->type) {
-            
-        case SIMPLE_COMMAND:
-            
-            pid = fork();
-            
-            if (pid == -1) { //error in fork()
-                fprintf(stderr, "Error in fork()!");
-                exit(1);
-            }
-            
-            else if (pid == 0) { //we are in the child process; execute simple command here
+    int exit_status = shell_status;     //status of the node that finished last
+    
+    struct exec_stack stack;
+    stack.size = 64 * sizeof(struct exec_frame);
+    stack.frames = checked_malloc(stack.size);
+    stack.depth = 0;
+    push_node(&stack, n);
+    
+    while (stack.depth > 0) {
+        
+        struct exec_frame *f = &stack.frames[stack.depth - 1];
+        n = f->node;
+        
+        switch (c->type[n]) {
                 
+            case SIMPLE_COMMAND:
                 
-                handle_IO(c);
+                exit_status = run_simple_command(c, n, exit_status);
+                stack.depth--;
                 
-                execvp(c->u.word[0], c->u.word);
+                //exit leaves everything up to the innermost subshell
+                if (exit_requested) {
+                    while (stack.depth > 0 && c->type[stack.frames[stack.depth - 1].node] != SUBSHELL_COMMAND)
+                        stack.depth--;
+                    if (stack.depth > 0) {
+                        leave_subshell(&stack.frames[--stack.depth]);
+                        exit_requested = false;
+                    }
+                }
+                break;
                 
-                //error in finding file
-                fprintf(stderr, "%s: command not found\n", c->u.word[0]);
-                exit(1);
+            case BACKGROUND_COMMAND:
                 
-            }
-            
-            
-            else {  //this is the parent
-                int status;
-                //wait for child to exit
+                //start the body in its own process and carry on at once
+                shell_status = exit_status;
+                reap_background_jobs();
+                pid = fork();
                 
-                while (-1 == waitpid(pid, &status, 0)){
-                    //    printf("Child has not exited yet! WIFEXITED returns %d\n", WIFEXITED(status));
+                if (pid == -1) {
+                    fprintf(stderr, "Error in fork() for BACKGROUND_COMMAND!");
+                    exit(1);
+                } else if (pid == 0) {
+                    forget_background_jobs();
+                    exec_if_simple(c, c->child[n][0]);
+                    exit_status = execute_node(c, c->child[n][0], time_travel);
+                    exit(exit_status < 0 ? 1 : exit_status);
                 }
-                /*
-                 printf("WIFEXITED returns %d\n", WIFEXITED(status));
-                 if (WIFEXITED(status)) {
-                 printf("first child exited with %u\n", status);*/
-                if (WIFEXITED(status)) {
-                    c->status = WEXITSTATUS(status);
-                    //printf("Exit status for %s command: %d\n", c->u.word[0], c->status);
+                
+                add_background_job(pid);
+                exit_status = 0;
+                stack.depth--;
+                break;
+                
+            case AND_COMMAND:
+                
+                //execute first command in array
+                if (f->stage == 0) {
+                    f->stage = 1;
+                    push_node(&stack, c->child[n][0]);
                 }
                 
-            }
-            
-            break;
-        case AND_COMMAND:
-            
-            //execute first command in array
-            execute_command(c->u.command[0], time_travel);
-            c->status = c->u.command[0]->status;
-            
-            //execute second command in array if first one exits 0 (i.e. true)
-            if (c->status == 0){
-                execute_command(c->u.command[1], time_travel);
-                c->status = c->u.command[1]->status;
+                //execute second command in array if first one exits 0 (i.e. true)
+                else if (f->stage == 1 && exit_status == 0) {
+                    f->stage = 2;
+                    push_node(&stack, c->child[n][1]);
+                }
                 
-            }
-            break;
-            
-        case OR_COMMAND:
-            //execute first command in array
-            execute_command(c->u.command[0], time_travel);
-            c->status = c->u.command[0]->status;
-            
-            //if first command isn't true, check second one
-            if (c->status != 0){
-                execute_command(c->u.command[1], time_travel);
-                c->status = c->u.command[1]->status;
-            }
-            
-            break;
-        case SEQUENCE_COMMAND:
-            //recursively call both commands
-            execute_command(c->u.command[0], time_travel);
-            //c->status = c->u.command[0]->status;
-            
-            execute_command(c->u.command[1], time_travel);
-            c->status = c->u.command[1]->status;
-            
-            break;
-        case PIPE_COMMAND:
-            /*
-             int pipe(int fildes[2]);
-             
-             The pipe() function shall create a pipe and place two file descriptors, one each into the arguments fildes[0] and fildes[1], that refer to the open file descriptions for the read and write ends of the pipe.
-             
-             Upon successful completion, 0 shall be returned; otherwise, -1 shall be returned and errno set to indicate the error.
-             */
-            
-            //make a pipe, check for successful creation
-            if (pipe(fildes) == -1){
-                fprintf(stderr, "Cannot create pipe.");
-                exit(1);
-            }
-            
-            pid = fork();
-            
-            if (pid == -1) { //error in fork()
-                fprintf(stderr, "Error in fork() for PIPE_COMMAND!");
-                exit(1);
-            } else if (pid == 0) { //child
-                
-                //close the READ portion (first element), then go on to check WRITE element
-                close(fildes[0]);
-                
-                /*
-                 dup2 to check to see if we can write to pipe
-                 remember: file descriptors have the following integer values:
-                 0: for standard input
-                 1: for standard output
-                 2: for standard error
-                 */
-                
-                if (dup2(fildes[1],1) == -1){
-                    
-                    fprintf(stderr, "Cannot write to pipe");
-                    exit(1);
+                else {
+                    stack.depth--;
                 }
+                break;
                 
-                execute_command(c->u.command[0], time_travel);
-                c->status = c->u.command[0]->status;
+            case OR_COMMAND:
+                //execute first command in array
+                if (f->stage == 0) {
+                    f->stage = 1;
+                    push_node(&stack, c->child[n][0]);
+                }
                 
-                close(fildes[1]);
-                exit(0);
+                //if first command isn't true, check second one
+                else if (f->stage == 1 && exit_status != 0) {
+                    f->stage = 2;
+                    push_node(&stack, c->child[n][1]);
+                }
+                
+                else {
+                    stack.depth--;
+                }
+                break;
                 
-            } else if (pid > 0) { //parent
+            case SEQUENCE_COMMAND:
+                //run both commands, one after the other
+                if (f->stage < 2) {
+                    push_node(&stack, c->child[n][f->stage++]);
+                } else {
+                    stack.depth--;
+                }
+                break;
                 
-                int status;
+            case PIPE_COMMAND:
                 
-                //wait for child to ext
-                while (-1 == waitpid(pid, &status, 0)){}
+                shell_status = exit_status;
+                exit_status = run_pipeline(c, n, time_travel);
+                stack.depth--;
+                break;
                 
-                //close the WRITE portion
-                close(fildes[1]);
+            case SUBSHELL_COMMAND:
                 
-                //check to see if we can use fildes[0] as input
-                if (dup2(fildes[0],0) == -1){
-                    fprintf(stderr, "dup2() for parent failed");
-                    exit(1);
+                if (f->stage == 1) {
+                    leave_subshell(f);
+                    stack.depth--;
+                    break;
                 }
                 
-                execute_command(c->u.command[1], time_travel);
-                c->status = c->u.command[1]->status;
+                f->cwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
                 
-                close(fildes[0]);
+                //the body runs with the subshell's redirections, if it has any
+                if (c->input[n])
+                    c->input[c->child[n][0]] = c->input[n];
+                if (c->output[n])
+                    c->output[c->child[n][0]] = c->output[n];
+                f->stage = 1;
+                push_node(&stack, c->child[n][0]);
                 
-            } else {    //error
-                fprintf(stderr, "Couldn't create child process (PIPE).");
+                break;
+                
+            default:
+                fprintf(stderr, "command is somehow invalid");
                 exit(1);
-            }
-            
-            break;
-            
-        case SUBSHELL_COMMAND:
-            
-            c->u.subshell_command->input=c->input;
-            c->u.subshell_command->output= c->output;
-            execute_command(c->u.subshell_command, time_travel);
-            
-            break;
-            
-        default:
-            fprintf(stderr, "command is somehow invalid");
-            exit(1);
-            break;
+                break;
+        }
     }
+    
+    free(stack.frames);
+    shell_status = exit_status;
+    return exit_status;
+}
+
+//what is time_travel?
+void
+execute_command (command_t c, int time_travel)
+{
+    c->status = execute_node(c, c->root, time_travel);
+    
+    //exit was run outside of any subshell
+    if (exit_requested)
+        exit(c->status);
 }
 
 void
@@ -592,6 +1314,14 @@ fork_and_begin_exec(command_t command, pid_t *proc_table, int index) {
     
     pid_t pid;
     
+    //look up the tree's commands here, so that every copy of the shell
+    //running a tree starts out knowing where the commands seen so far are
+    uint32_t n;
+    for (n = 0; n < command->num_nodes; n++) {
+        if (command->type[n] == SIMPLE_COMMAND && !is_builtin(command, n))
+            find_command(command->word[command->child[n][0]]);
+    }
+    
     pid = fork();
     
     if (pid == -1) {
@@ -601,7 +1331,10 @@ fork_and_begin_exec(command_t command, pid_t *proc_table, int index) {
     else if (pid == 0) {
         
         //printf("executing first command\n");
+        exec_if_simple(command, command->root);
         execute_command(command, 0);
+        //trees that depend on this one also depend on what it started with '&'
+        command_status(command);
         //printf("                  about to exit command\n");
         exit(0);
     }
@@ -667,8 +1400,6 @@ int check_blocked_command_dependencies(command_stream_t cstream, pid_t *proc_tab
 void
 exec_time_travel(command_stream_t cstream) {
     
-    make_dependency_lists(cstream);
-    
     commandNode_t cNode;
     
     pid_t *process_table = checked_malloc(cstream->num_nodes * sizeof(pid_t));
@@ -724,8 +1455,8 @@ exec_time_travel(command_stream_t cstream) {
             
             int status;
             
-            //if a cNode is not flagged as done
-            if (update->command_tree_done_executing == false) {
+            //if a cNode is running and not flagged as done
+            if (update->command_tree_done_executing == false && update->command_tree_begun_executing == true) {
                 
                 //check if its done now
                 
@@ -733,7 +1464,8 @@ exec_time_travel(command_stream_t cstream) {
                 
                 //printf("check pid: %d\n", check_pid);
                 
-                if (check_pid != 0){
+                if (check_pid == process_table[update->tree_number - 1]){
+                    path_epoch++;
                     update->command_tree_done_executing = true;
                     process_table[update->tree_number - 1] = -1;
                     number_of_finished++;
@@ -772,6 +1504,7 @@ exec_time_travel(command_stream_t cstream) {
                 //printf("check pid: %d\n", check_pid);
                 
                 if (check_pid == process_table[update->tree_number-1]){
+                    path_epoch++;
                     update->command_tree_done_executing = true;
                     process_table[update->tree_number - 1] = -1;
                     number_of_finished++;
@@ -0,0 +1,561 @@
+// UCLA CS 111 Lab 1 parser performance fuzzing
+
+/* Parse inputs of a given size and check that each is parsed within a
+ time and allocation budget that grows linearly with its size.  Inputs
+ are the shapes named on the command line, each scaled up to the size,
+ followed by random scripts, some of them mangled into syntax errors.
+ Each input is checked with check_command_syntax, and if it is valid,
+ read one tree at a time through make_command_stream and parsed whole
+ with finish_command_stream, as time travel does.
+
+ The program is linked with malloc, realloc and free wrapped, so it can
+ count the bytes the parser has allocated.  */
+
+#include "command-internals.h"
+#include "command.h"
+#include "alloc.h"
+
+#include <errno.h>
+#include <error.h>
+#include <getopt.h>
+#include <malloc.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static char const *program_name;
+
+/* The budgets.  They are loose enough for an unoptimized build on a busy
+ machine; anything quadratic in a megabyte of input overruns them by
+ orders of magnitude.  */
+enum { TIME_BASE_NS = 50 * 1000 * 1000, TIME_PER_BYTE_NS = 2000 };
+enum { ALLOC_BASE = 1 << 20, ALLOC_PER_BYTE = 512 };
+
+/* An input still being parsed after this many times its time budget is
+ taken to be stuck.  */
+enum { HANG_FACTOR = 10 };
+
+/* Counting allocations.  The parser may allocate from several threads.  */
+
+void *__real_malloc (size_t);
+void *__real_realloc (void *, size_t);
+void __real_free (void *);
+
+static size_t live_bytes;
+static size_t peak_bytes;
+
+// Allocating past this gives up on the input at once, rather than wait
+// for a quadratic amount of memory.
+static size_t max_live_bytes = -1;
+
+static void give_up (char const *why);
+
+static void
+note_alloc (size_t size)
+{
+    size_t live = __atomic_add_fetch (&live_bytes, size, __ATOMIC_RELAXED);
+    if (live > max_live_bytes)
+        give_up ("allocated more than its budget");
+    size_t peak = __atomic_load_n (&peak_bytes, __ATOMIC_RELAXED);
+    while (peak < live
+           && ! __atomic_compare_exchange_n (&peak_bytes, &peak, live, 1,
+                                             __ATOMIC_RELAXED,
+                                             __ATOMIC_RELAXED))
+        continue;
+}
+
+static void
+note_free (size_t size)
+{
+    __atomic_sub_fetch (&live_bytes, size, __ATOMIC_RELAXED);
+}
+
+void *
+__wrap_malloc (size_t size)
+{
+    void *p = __real_malloc (size);
+    if (p)
+        note_alloc (malloc_usable_size (p));
+    return p;
+}
+
+void *
+__wrap_realloc (void *ptr, size_t size)
+{
+    size_t old_size = ptr ? malloc_usable_size (ptr) : 0;
+    void *p = __real_realloc (ptr, size);
+    if (p)
+    {
+        note_free (old_size);
+        note_alloc (malloc_usable_size (p));
+    }
+    return p;
+}
+
+void
+__wrap_free (void *ptr)
+{
+    if (ptr)
+        note_free (malloc_usable_size (ptr));
+    __real_free (ptr);
+}
+
+/* Growing text.  */
+
+struct text
+{
+    char *data;
+    size_t used;
+    size_t size;
+};
+
+static void
+append (struct text *t, char const *data, size_t size)
+{
+    while (t->size < t->used + size + 1)
+    {
+        if (! t->size)
+            t->size = 1024;
+        t->data = checked_grow_alloc (t->data, &t->size);
+    }
+    memcpy (t->data + t->used, data, size);
+    t->used += size;
+    t->data[t->used] = '\0';
+}
+
+static void
+append_string (struct text *t, char const *s)
+{
+    append (t, s, strlen (s));
+}
+
+/* Shapes.  A shape file has comment lines starting with '#' and up to
+ three lines of the form NAME "TEXT", where NAME is "open", "middle" or
+ "close" and TEXT may use the escapes \n, \t, \" and \\.  The input is
+ OPEN repeated N times, then MIDDLE, then CLOSE repeated N times, with N
+ as large as fits in the size asked for.  In OPEN and CLOSE, %d stands
+ for the number of the repetition, so repeated trees need not be the
+ same, and %% for a '%'.  */
+
+struct shape
+{
+    struct text open, middle, close;
+};
+
+static void
+read_shape (struct shape *shape, char const *file_name)
+{
+    FILE *f = fopen (file_name, "r");
+    if (! f)
+        error (1, errno, "%s: cannot open", file_name);
+
+    memset (shape, 0, sizeof *shape);
+    char line[4096];
+    int line_number = 0;
+    while (fgets (line, sizeof line, f))
+    {
+        line_number++;
+        char *p = line + strspn (line, " \t");
+        if (*p == '#' || *p == '\n' || ! *p)
+            continue;
+
+        size_t name_length = strcspn (p, " \t");
+        struct text *t = 0;
+        if (name_length == 4 && ! strncmp (p, "open", 4))
+            t = &shape->open;
+        else if (name_length == 6 && ! strncmp (p, "middle", 6))
+            t = &shape->middle;
+        else if (name_length == 5 && ! strncmp (p, "close", 5))
+            t = &shape->close;
+        p += name_length;
+        p += strspn (p, " \t");
+        if (! t || *p++ != '"')
+            error (1, 0, "%s:%d: expected open, middle or close \"TEXT\"",
+                   file_name, line_number);
+
+        for (; *p != '"'; p++)
+        {
+            char c = *p;
+            if (! c || c == '\n')
+                error (1, 0, "%s:%d: unterminated text", file_name,
+                       line_number);
+            if (c == '\\')
+                switch (*++p)
+                {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case '"': c = '"'; break;
+                case '\\': c = '\\'; break;
+                default:
+                    error (1, 0, "%s:%d: unknown escape", file_name,
+                           line_number);
+                }
+            append (t, &c, 1);
+        }
+    }
+
+    if (ferror (f) || fclose (f) != 0)
+        error (1, errno, "%s: cannot read", file_name);
+    if (! shape->open.used)
+        error (1, 0, "%s: nothing to repeat", file_name);
+}
+
+/* Append T with %d replaced by I.  */
+static void
+append_repetition (struct text *input, struct text const *t, long i)
+{
+    char const *p = t->data;
+    char const *end = p + t->used;
+    while (p < end)
+    {
+        char const *percent = memchr (p, '%', end - p);
+        if (! percent || percent + 1 == end)
+        {
+            append (input, p, end - p);
+            return;
+        }
+        append (input, p, percent - p);
+        if (percent[1] == 'd')
+        {
+            char number[32];
+            sprintf (number, "%ld", i);
+            append_string (input, number);
+        }
+        else
+            append (input, percent + 1, 1);
+        p = percent + 2;
+    }
+}
+
+static void
+make_shape_input (struct text *input, struct shape const *shape,
+                  size_t size)
+{
+    // OPEN gets its share of the size if there is a CLOSE to match it.
+    size_t open_size = size * shape->open.used
+                       / (shape->open.used + shape->close.used);
+    input->used = 0;
+    append (input, "", 0);
+    long n;
+    for (n = 0; input->used + shape->middle.used < open_size; n++)
+        append_repetition (input, &shape->open, n);
+    append (input, shape->middle.data ? shape->middle.data : "",
+            shape->middle.used);
+    long i;
+    for (i = 0; i < n && shape->close.used; i++)
+        append_repetition (input, &shape->close, i);
+}
+
+/* Random scripts.  */
+
+static unsigned long long random_state;
+
+static unsigned
+random_below (unsigned n)
+{
+    random_state = random_state * 6364136223846793005ull
+                   + 1442695040888963407ull;
+    return (random_state >> 33) % n;
+}
+
+static char const *const random_words[] =
+  { "a", "b", "cat", "echo", "sort", "x1", "-n", "f.txt", "true", ":" };
+static char const *const random_files[] = { "f", "g", "h" };
+static char const *const random_operators[] =
+  { " && ", " || ", " | ", " ; ", "\n", " &&\n", " |\n", " & " };
+
+enum { MAX_RANDOM_DEPTH = 12 };
+
+static void
+append_random_command (struct text *t, int depth)
+{
+    unsigned choice = depth < MAX_RANDOM_DEPTH ? random_below (8) : 0;
+    if (choice < 3)
+    {
+        int words = 1 + random_below (4);
+        while (words--)
+        {
+            append_string (t, random_words[random_below (10)]);
+            if (words)
+                append_string (t, " ");
+        }
+    }
+    else if (choice == 3)
+    {
+        append_string (t, "(");
+        append_random_command (t, depth + 1);
+        append_string (t, ")");
+    }
+    else
+    {
+        append_random_command (t, depth + 1);
+        append_string (t, random_operators[random_below (8)]);
+        append_random_command (t, depth + 1);
+        return;
+    }
+
+    if (! random_below (4))
+    {
+        append_string (t, " <");
+        append_string (t, random_files[random_below (3)]);
+    }
+    if (! random_below (4))
+    {
+        append_string (t, " >");
+        append_string (t, random_files[random_below (3)]);
+    }
+}
+
+static void
+make_random_input (struct text *input, size_t size)
+{
+    input->used = 0;
+    append (input, "", 0);
+    while (input->used < size)
+    {
+        append_random_command (input, 0);
+        if (! random_below (8))
+            append_string (input, " &");
+        append_string (input, random_below (8) ? "\n\n" : "\n# note\n\n");
+    }
+
+    // Mangle a quarter of the scripts, which makes most of them invalid.
+    if (! random_below (4))
+    {
+        static char const noise[] = ";&|()<> \n#a";
+        int n = 1 + random_below (8);
+        while (n--)
+            input->data[random_below (input->used)]
+              = noise[random_below (sizeof noise - 1)];
+    }
+}
+
+/* Running an input against the budgets.  */
+
+// What is being parsed, for reporting a parse that never returns.
+static char const *current_input;
+static char const *current_mode;
+
+static void
+report_exit (void)
+{
+    if (current_mode)
+        printf ("%s: %s (%s): the parser exited\n", program_name,
+                current_input, current_mode);
+}
+
+/* Say that the current input WHY, and exit.  This may be called from a
+ signal handler or in the middle of malloc, so it only calls write and
+ _exit; stdout is line buffered, so nothing printed before is lost.  */
+static void
+give_up (char const *why)
+{
+    char const *parts[] = { program_name, ": ", current_input, " (",
+                            current_mode, "): ", why, "; giving up\n" };
+    size_t i;
+    for (i = 0; i < sizeof parts / sizeof *parts; i++)
+        if (write (STDOUT_FILENO, parts[i], strlen (parts[i])) < 0)
+            break;
+    _exit (1);
+}
+
+static void
+report_hang (int sig)
+{
+    give_up ("is still being parsed");
+}
+
+struct cost
+{
+    long long ns;
+    size_t bytes;
+};
+
+static long long
+now_ns (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static size_t start_bytes;
+static long long start_ns;
+
+static long long
+time_budget (size_t size)
+{
+    return TIME_BASE_NS + (long long) TIME_PER_BYTE_NS * size;
+}
+
+static size_t
+alloc_budget (size_t size)
+{
+    return ALLOC_BASE + (size_t) ALLOC_PER_BYTE * size;
+}
+
+/* Start timing MODE on an input of SIZE bytes, which may allocate at
+ most MAX_BYTES.  */
+static void
+begin (char const *mode, size_t size, size_t max_bytes)
+{
+    current_mode = mode;
+    alarm (HANG_FACTOR * (time_budget (size) / 1000000000 + 1));
+    start_bytes = __atomic_load_n (&live_bytes, __ATOMIC_RELAXED);
+    __atomic_store_n (&peak_bytes, start_bytes, __ATOMIC_RELAXED);
+    max_live_bytes = start_bytes + max_bytes;
+    start_ns = now_ns ();
+}
+
+static struct cost
+end (void)
+{
+    struct cost c;
+    c.ns = now_ns () - start_ns;
+    c.bytes = __atomic_load_n (&peak_bytes, __ATOMIC_RELAXED) - start_bytes;
+    alarm (0);
+    max_live_bytes = -1;
+    current_mode = 0;
+    return c;
+}
+
+static int
+next_byte (void *arg)
+{
+    char const **p = arg;
+    return **p ? (unsigned char) *(*p)++ : EOF;
+}
+
+/* Check the time C took to parse SIZE bytes in MODE against its budget.
+ (Allocations are checked as they are made.)  Return 1 if it is over.  */
+static int
+over_budget (struct cost c, char const *mode, size_t size)
+{
+    long long max_ns = time_budget (size);
+    if (c.ns <= max_ns)
+        return 0;
+    printf ("%s: %s (%s): took %lld ms, budget %lld ms\n", program_name,
+            current_input, mode, c.ns / 1000000, max_ns / 1000000);
+    return 1;
+}
+
+/* Parse INPUT, named NAME, every way there is, and return 1 if any of
+ them took too long.  */
+static int
+run_input (char const *name, struct text const *input, int verbose)
+{
+    char const *script = input->data;
+    size_t size = input->used;
+    current_input = name;
+    int failures = 0;
+
+    // Checking syntax allocates nothing at all.
+    begin ("check", size, 0);
+    int errors = check_command_syntax (name, script, size);
+    struct cost check_cost = end ();
+    failures += over_budget (check_cost, "check", size);
+
+    struct cost read_cost = { 0, 0 };
+    struct cost finish_cost = { 0, 0 };
+    if (! errors)
+    {
+        command_stream_t s;
+        command_t c;
+
+        // One tree at a time, as the script arrives.
+        char const *p = script;
+        begin ("read", size, alloc_budget (size));
+        s = make_command_stream (next_byte, &p);
+        while ((c = read_command_stream (s)))
+            free_command (c);
+        read_cost = end ();
+        failures += over_budget (read_cost, "read", size);
+
+        // All of the trees at once, as time travel wants them.
+        char *copy = checked_malloc (size + 1);
+        memcpy (copy, script, size + 1);
+        begin ("finish", size, alloc_budget (size));
+        s = make_command_stream_in_place (copy, size);
+        finish_command_stream (s);
+        finish_cost = end ();
+        failures += over_budget (finish_cost, "finish", size);
+        while ((c = read_command_stream (s)))
+            free_command (c);
+        free (copy);
+    }
+
+    if (verbose)
+        printf ("%s: %zu bytes, %s; check %lld ms, read %lld ms %zu bytes,"
+                " finish %lld ms %zu bytes\n", name, size,
+                errors ? "invalid" : "valid", check_cost.ns / 1000000,
+                read_cost.ns / 1000000, read_cost.bytes,
+                finish_cost.ns / 1000000, finish_cost.bytes);
+    return failures != 0;
+}
+
+static void
+usage (void)
+{
+    error (1, 0, "usage: %s [-v] [-r RUNS] [-s SIZE] [-S SEED] [SHAPE-FILE]...",
+           program_name);
+}
+
+int
+main (int argc, char **argv)
+{
+    size_t size = 1 << 20;
+    long runs = 200;
+    int verbose = 0;
+    int opt;
+
+    program_name = argv[0];
+    random_state = 1;
+
+    // give_up cannot flush stdout, so let no line wait in its buffer.
+    setvbuf (stdout, 0, _IOLBF, 0);
+    while ((opt = getopt (argc, argv, "r:s:S:v")) != -1)
+        switch (opt)
+        {
+        case 'r': runs = atol (optarg); break;
+        case 's': size = strtoul (optarg, 0, 0); break;
+        case 'S': random_state = strtoull (optarg, 0, 0); break;
+        case 'v': verbose = 1; break;
+        default: usage (); break;
+        }
+
+    // The inputs' syntax errors are expected; only the budgets matter.
+    if (! freopen ("/dev/null", "w", stderr))
+        error (1, errno, "/dev/null");
+    signal (SIGALRM, report_hang);
+    atexit (report_exit);
+
+    struct text input = { 0, 0, 0 };
+    int failures = 0;
+    int i;
+    for (i = optind; i < argc; i++)
+    {
+        struct shape shape;
+        read_shape (&shape, argv[i]);
+        make_shape_input (&input, &shape, size);
+        failures += run_input (argv[i], &input, verbose);
+        free (shape.open.data);
+        free (shape.middle.data);
+        free (shape.close.data);
+    }
+
+    // Random scripts are smaller, so that there can be many of them.
+    long r;
+    for (r = 0; r < runs; r++)
+    {
+        char name[64];
+        sprintf (name, "random script %ld", r);
+        make_random_input (&input, size / 16);
+        failures += run_input (name, &input, verbose);
+    }
+
+    printf ("%s: %d inputs took too long\n", program_name, failures);
+    return failures != 0;
+}
@@ -0,0 +1,108 @@
+// UCLA CS 111 Lab 1 string interning
+
+#include "intern.h"
+#include "alloc.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct interned
+{
+    char const *text;
+    size_t length;
+    uint32_t hash;
+};
+
+// Strings by id; entry 0 is unused so that 0 never names a string.
+static struct interned *strings;
+static size_t strings_size;     // bytes allocated for STRINGS
+static int num_strings;
+
+// Open-addressed hash table of ids, 0 meaning empty.  Its size is a
+// power of two and it is kept at most half full.
+static int *slots;
+static size_t num_slots;
+
+// Copies of the strings themselves.
+static struct arena *text_arena;
+
+static uint32_t
+hash_string (char const *text, size_t length)
+{
+    // FNV-1a.
+    uint32_t h = 2166136261u;
+    size_t i;
+    for (i = 0; i < length; i++)
+    {
+        h ^= (unsigned char) text[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void
+grow_slots (void)
+{
+    size_t new_num_slots = num_slots ? 2 * num_slots : 1024;
+    int *new_slots = checked_malloc (new_num_slots * sizeof *new_slots);
+    memset (new_slots, 0, new_num_slots * sizeof *new_slots);
+
+    int id;
+    for (id = 1; id <= num_strings; id++)
+    {
+        size_t i = strings[id].hash & (new_num_slots - 1);
+        while (new_slots[i])
+            i = (i + 1) & (new_num_slots - 1);
+        new_slots[i] = id;
+    }
+
+    free (slots);
+    slots = new_slots;
+    num_slots = new_num_slots;
+}
+
+int
+intern_string (char const *text, size_t length)
+{
+    if (2 * (size_t) (num_strings + 1) > num_slots)
+        grow_slots ();
+
+    uint32_t h = hash_string (text, length);
+    size_t i = h & (num_slots - 1);
+    int id;
+    for (; (id = slots[i]); i = (i + 1) & (num_slots - 1))
+    {
+        struct interned const *s = &strings[id];
+        if (s->hash == h && s->length == length
+            && memcmp (s->text, text, length) == 0)
+            return id;
+    }
+
+    // A new string: copy it and give it the next id.
+    if (! text_arena)
+    {
+        text_arena = arena_create ();
+        strings_size = 1024 * sizeof *strings;
+        strings = checked_malloc (strings_size);
+    }
+    if ((num_strings + 2) * sizeof *strings > strings_size)
+        strings = checked_grow_alloc (strings, &strings_size);
+
+    char *copy = arena_alloc (text_arena, length + 1);
+    memcpy (copy, text, length);
+    copy[length] = '\0';
+
+    id = ++num_strings;
+    strings[id].text = copy;
+    strings[id].length = length;
+    strings[id].hash = h;
+    slots[i] = id;
+    return id;
+}
+
+char const *
+interned_string (int id)
+{
+    return strings[id].text;
+}
@@ -0,0 +1,11 @@
+// UCLA CS 111 Lab 1 string interning
+#include <stddef.h>
+
+/* Return a small positive integer identifying the LENGTH bytes at TEXT.
+ Equal strings always get the same id, so callers can compare ids
+ instead of calling strcmp.  The table keeps one copy of each distinct
+ string.  */
+int intern_string (char const *text, size_t length);
+
+/* Return the '\0'-terminated string whose id is ID.  */
+char const *interned_string (int id);
@@ -7,10 +7,13 @@
 #include <error.h>
 #include <errno.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include "command-internals.h"
 #include "command.h"
 #include "alloc.h"
+#include "script-buffer.h"
+#include "script-cache.h"
 
 static char const *program_name;
 static char const *script_name;
@@ -18,13 +21,42 @@ static char const *script_name;
 static void
 usage (void)
 {
-    error (1, 0, "usage: %s [-pt] SCRIPT-FILE", program_name);
+    error (1, 0, "usage: %s [-ptv] SCRIPT-FILE\n"
+           "   or: %s -n SCRIPT-FILE...", program_name, program_name);
 }
 
-static int
-get_next_byte (void *stream)
+/* If SCRIPT_NAME ("-" for standard input) is not a regular file, say
+ because a generator is writing it to a pipe, return it opened, to be
+ read in large chunks as it is parsed.  Return 0 for a regular file,
+ which is better mapped with load_script.  */
+static FILE *
+open_script_stream (char const *file_name)
 {
-    return getc (stream);
+    FILE *stream = strcmp (file_name, "-") == 0 ? stdin
+                   : fopen (file_name, "r");
+    if (! stream)
+        error (1, errno, "%s: cannot open", file_name);
+
+    struct stat st;
+    if (fstat (fileno (stream), &st) != 0)
+        error (1, errno, "%s: cannot stat", file_name);
+    if (! S_ISREG (st.st_mode))
+        return stream;
+
+    if (stream != stdin)
+        fclose (stream);
+    return 0;
+}
+
+static struct optimize_stats optimized;
+
+// With -v, say what the optimizer saved.
+static void
+report_optimized (int verbose)
+{
+    if (verbose)
+        fprintf (stderr, "%s: optimized away %ld nodes\n",
+                 program_name, optimized.nodes);
 }
 
 int
@@ -32,50 +64,124 @@ main (int argc, char **argv)
 {
     int opt;
     int command_number = 1;
+    int check_only = 0;
     int print_tree = 0;
     int time_travel = 0;
+    int verbose = 0;
     program_name = argv[0];
     
     for (;;)
-        switch (getopt (argc, argv, "pt"))
+        switch (getopt (argc, argv, "nptv"))
     {
+        case 'n': check_only = 1; break;
         case 'p': print_tree = 1; break;
         case 't': time_travel = 1; break;
+        case 'v': verbose = 1; break;
         default: usage (); break;
         case -1: goto options_exhausted;
     }
 options_exhausted:;
     
+    // Only check the syntax of each script, as a linter would.  Checking
+    // many scripts in one run saves starting a process for each.
+    if (check_only)
+    {
+        if (optind == argc || print_tree || time_travel)
+            usage ();
+        int errors = 0;
+        for (; optind < argc; optind++)
+        {
+            struct script_buffer script;
+            load_script (&script, argv[optind]);
+            errors += check_command_syntax (argv[optind], script.data,
+                                            script.size);
+            release_script (&script);
+        }
+        return errors != 0;
+    }
+    
     // There must be exactly one file argument.
     if (optind != argc - 1)
         usage ();
     
     script_name = argv[optind];
-    FILE *script_stream = fopen (script_name, "r");
-    if (! script_stream)
-        error (1, errno, "%s: cannot open", script_name);
-    command_stream_t command_stream =
-    make_command_stream (get_next_byte, script_stream);
+    struct script_buffer script;
     
-    command_t last_command = NULL;
-    command_t command;
     if (time_travel == 1){
+        load_script (&script, script_name);
+
+        // Reuse the trees and dependencies worked out by an earlier run
+        // of the same script, if there was one.
+        struct script_cache cache;
+        command_stream_t command_stream =
+        open_script_cache (&cache, script_name, &script);
+        if (!command_stream)
+        {
+            command_stream = make_command_stream_in_place (script.data,
+                                                           script.size);
+            finish_command_stream (command_stream);
+            make_dependency_lists (command_stream);
+            
+            // The read and write lists were made before this, so they
+            // may still name arguments of dropped commands; that can only
+            // add dependencies, never lose one.
+            // A tree shared by several nodes is optimized once, through
+            // the node it was first parsed for.
+            commandNode_t node;
+            for (node = command_stream->head; node; node = node->next)
+                if (node->cmd->tree_number == node->tree_number)
+                    optimize_command (node->cmd, &optimized);
+            save_script_cache (&cache, command_stream);
+        }
         exec_time_travel(command_stream);
+        report_optimized (verbose);
         exit(0);
     }
+    
+    // Without time travel, only one tree is needed at a time, so memory
+    // stays the same however long the script is: a script that is not a
+    // regular file is read as it is parsed, and the pages of a mapped
+    // script are given back once the trees parsed from them are done.
+    command_stream_t command_stream;
+    FILE *script_stream = open_script_stream (script_name);
+    if (script_stream)
+        command_stream = make_command_stream_from_fd (fileno (script_stream));
+    else
+    {
+        load_script (&script, script_name);
+        command_stream = make_command_stream_in_place (script.data,
+                                                       script.size);
+    }
+    
+    command_t last_command = NULL;
+    command_t command;
     while ((command = read_command_stream (command_stream)))
     {
+        // Keep only the tree whose status we may still need.  Its words
+        // may be in pages already given back, but its status is not.
+        if (last_command)
+            free_command (last_command);
+        last_command = NULL;
+        
         if (print_tree)
         {
             printf ("# %d\n", command_number++);
             print_command (command);
+            free_command (command);
         }
         else
         {
-            last_command = command;
+            optimize_command (command, &optimized);
             execute_command (command, time_travel);
+            last_command = command;
         }
+        if (! script_stream)
+            release_script_prefix (&script,
+                                   command_stream_position (command_stream));
     }
     
-    return print_tree || !last_command ? 0 : command_status (last_command);
+    // This also waits for any commands still running in the background.
+    int status = last_command ? command_status (last_command) : 0;
+    report_optimized (verbose);
+    return status;
 }
@@ -0,0 +1,182 @@
+// UCLA CS 111 Lab 1 command tree simplification
+
+#include "command.h"
+#include "command-internals.h"
+#include "alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* If a simple command with words WORD does nothing but exit, return
+ its exit status; otherwise return -1.  */
+static int
+no_op_status (char **word)
+{
+    if (strcmp (word[0], ":") == 0 || strcmp (word[0], "true") == 0)
+        return 0;
+    if (strcmp (word[0], "false") == 0)
+        return 1;
+    return -1;
+}
+
+/* Whether a simple command with words WORD is a bare "exit", which exits
+ with the status of the command run before it.  */
+static int
+is_bare_exit (char **word)
+{
+    return strcmp (word[0], "exit") == 0 && ! word[1];
+}
+
+void
+optimize_command (command_t c, struct optimize_stats *stats)
+{
+    uint32_t num_nodes = c->num_nodes;
+
+    // For each node: the node that now stands for it, and its exit status
+    // if running it has no other effect, or -1.
+    uint32_t *replaced = checked_malloc (num_nodes * sizeof *replaced);
+    signed char *no_op = checked_malloc (num_nodes);
+
+    // For each node: whether a command that runs first in it is a bare
+    // exit, which reads the status of what ran before the node, so that
+    // must not be dropped or folded away.
+    unsigned char *reads_status = checked_malloc (num_nodes);
+
+    // Children are numbered before their parents, so by the time a node
+    // is reached its children have been simplified.
+    uint32_t n;
+    for (n = 0; n < num_nodes; n++)
+    {
+        uint32_t *child = c->child[n];
+        int redirected = c->input[n] || c->output[n];
+        replaced[n] = n;
+        no_op[n] = -1;
+        reads_status[n] = 0;
+
+        switch (c->type[n])
+        {
+        case SIMPLE_COMMAND:
+            if (! redirected)
+                no_op[n] = no_op_status (&c->word[child[0]]);
+            reads_status[n] = is_bare_exit (&c->word[child[0]]);
+            break;
+
+        case SUBSHELL_COMMAND:
+        {
+            // Of two nested subshells, one with no redirections can go.
+            uint32_t body = child[0] = replaced[child[0]];
+            if (c->type[body] == SUBSHELL_COMMAND)
+            {
+                if (! c->input[body] && ! c->output[body])
+                    body = child[0] = c->child[body][0];
+                else if (! redirected)
+                {
+                    replaced[n] = body;
+                    break;
+                }
+            }
+            if (! redirected)
+                no_op[n] = no_op[body];
+            reads_status[n] = reads_status[body];
+            break;
+        }
+
+        case BACKGROUND_COMMAND:
+        {
+            // Starting a no-op in the background is a no-op that succeeds.
+            uint32_t body = child[0] = replaced[child[0]];
+            if (no_op[body] >= 0)
+                no_op[n] = 0;
+            reads_status[n] = reads_status[body];
+            break;
+        }
+
+        case SEQUENCE_COMMAND:
+        case AND_COMMAND:
+        case OR_COMMAND:
+        case PIPE_COMMAND:
+        {
+            uint32_t left = child[0] = replaced[child[0]];
+            uint32_t right = child[1] = replaced[child[1]];
+
+            // Every stage of a pipeline starts with the status from
+            // before it; otherwise the left side runs first.
+            reads_status[n] = reads_status[left]
+                              || (c->type[n] == PIPE_COMMAND
+                                  && reads_status[right]);
+
+            // Nothing on the left can go if a bare exit on the right
+            // reads its status.
+            if (reads_status[right])
+                break;
+
+            // ';' ignores its left side's status, so in "X ; true ; Y",
+            // parsed as "(X ; true) ; Y", the true can go too.
+            if (c->type[n] == SEQUENCE_COMMAND
+                && c->type[left] == SEQUENCE_COMMAND
+                && no_op[c->child[left][1]] == 0)
+                left = child[0] = c->child[left][0];
+
+            // "true ; X", "true && X" and "false || X" all run just X.
+            if ((c->type[n] == SEQUENCE_COMMAND && no_op[left] == 0)
+                || (c->type[n] == AND_COMMAND && no_op[left] == 0)
+                || (c->type[n] == OR_COMMAND && no_op[left] == 1))
+                replaced[n] = right;
+            break;
+        }
+
+        default:
+            abort ();
+        }
+    }
+
+    uint32_t root = replaced[c->root];
+
+    // Find the nodes still in the tree.  Parents come after their
+    // children, so one pass down from the root reaches them all.
+    unsigned char *live = (unsigned char *) no_op;
+    memset (live, 0, num_nodes);
+    live[root] = 1;
+    for (n = root + 1; n-- > 0; )
+        if (live[n] && c->type[n] != SIMPLE_COMMAND)
+        {
+            live[c->child[n][0]] = 1;
+            if (c->type[n] != SUBSHELL_COMMAND
+                && c->type[n] != BACKGROUND_COMMAND)
+                live[c->child[n][1]] = 1;
+        }
+
+    // Renumber the live nodes in order, which keeps children before
+    // parents, and count the rest.  The simple commands dropped are
+    // builtins, which never started a process, so only nodes are counted.
+    uint32_t kept = 0;
+    for (n = 0; n < num_nodes; n++)
+    {
+        if (! live[n])
+        {
+            stats->nodes++;
+            continue;
+        }
+
+        uint32_t m = kept++;
+        replaced[n] = m;
+        c->type[m] = c->type[n];
+        c->input[m] = c->input[n];
+        c->output[m] = c->output[n];
+        c->child[m][0] = c->child[n][0];
+        c->child[m][1] = c->child[n][1];
+        if (c->type[m] != SIMPLE_COMMAND)
+        {
+            c->child[m][0] = replaced[c->child[m][0]];
+            if (c->type[m] != SUBSHELL_COMMAND
+                && c->type[m] != BACKGROUND_COMMAND)
+                c->child[m][1] = replaced[c->child[m][1]];
+        }
+    }
+
+    c->root = replaced[root];
+    c->num_nodes = kept;
+    free (replaced);
+    free (no_op);
+    free (reads_status);
+}
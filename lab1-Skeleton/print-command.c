@@ -2,57 +2,139 @@
 
 #include "command.h"
 #include "command-internals.h"
+#include "alloc.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 
+// A node being printed, and how much of it has been printed: nothing
+// yet, its first part (an operator's left side or a body), or
+// an operator's right side as well.
+struct print_frame
+{
+    uint32_t node;
+    int indent;
+    int stage;
+};
+
+/* Whether the text printed for node N of C ends with "&", which ends a
+ command as ";" does.  */
+static bool
+ends_in_background (command_t c, uint32_t n)
+{
+    while (c->type[n] == SEQUENCE_COMMAND)
+        n = c->child[n][1];
+    return c->type[n] == BACKGROUND_COMMAND;
+}
+
+/* Print node N of C and everything under it, with an explicit stack
+ rather than recursion, so that even very deep trees print.  */
 static void
-command_indented_print (int indent, command_t c)
+command_indented_print (int indent, command_t c, uint32_t n)
 {
-    switch (c->type)
+    static char const command_label[][3] = { "&&", ";", "||", "|" };
+    size_t size = 64 * sizeof (struct print_frame);
+    struct print_frame *stack = checked_malloc (size);
+    size_t depth = 0;
+
+    stack[depth].node = n;
+    stack[depth].indent = indent;
+    stack[depth].stage = 0;
+    depth++;
+
+    while (depth)
     {
-        case AND_COMMAND:
-        case SEQUENCE_COMMAND:
-        case OR_COMMAND:
-        case PIPE_COMMAND:
+        struct print_frame *f = &stack[depth - 1];
+        uint32_t child = -1;
+        int child_indent = 0;
+        n = f->node;
+        indent = f->indent;
+        int type = c->type[n];
+
+        switch (type)
         {
-            command_indented_print (indent + 2 * (c->u.command[0]->type != c->type),
-                                    c->u.command[0]);
-            static char const command_label[][3] = { "&&", ";", "||", "|" };
-            printf (" \\\n%*s%s\n", indent, "", command_label[c->type]);
-            command_indented_print (indent + 2 * (c->u.command[1]->type != c->type),
-                                    c->u.command[1]);
-            break;
+            case AND_COMMAND:
+            case SEQUENCE_COMMAND:
+            case OR_COMMAND:
+            case PIPE_COMMAND:
+                if (f->stage == 1)
+                {
+                    // "a & ; b" would not parse, so the "&" stands alone.
+                    if (type == SEQUENCE_COMMAND
+                        && ends_in_background (c, c->child[n][0]))
+                        putchar ('\n');
+                    else
+                        printf (" \\\n%*s%s\n", indent, "",
+                                command_label[type]);
+                }
+                if (f->stage < 2)
+                {
+                    child = c->child[n][f->stage++];
+                    child_indent = indent + 2 * (c->type[child] != type);
+                }
+                break;
+
+            case SIMPLE_COMMAND:
+            {
+                char **w = &c->word[c->child[n][0]];
+                printf ("%*s%s", indent, "", *w);
+                while (*++w)
+                    printf (" %s", *w);
+                break;
+            }
+
+            case SUBSHELL_COMMAND:
+                if (f->stage == 0)
+                {
+                    printf ("%*s(\n", indent, "");
+                    f->stage = 1;
+                    child = c->child[n][0];
+                    child_indent = indent + 1;
+                }
+                else
+                    printf ("\n%*s)", indent, "");
+                break;
+
+            case BACKGROUND_COMMAND:
+                if (f->stage == 0)
+                {
+                    f->stage = 1;
+                    child = c->child[n][0];
+                    child_indent = indent;
+                }
+                else
+                    printf (" &");
+                break;
+
+            default:
+                abort ();
         }
-            
-        case SIMPLE_COMMAND:
+
+        if (child != (uint32_t) -1)
         {
-            char **w = c->u.word;
-            printf ("%*s%s", indent, "", *w);
-            while (*++w)
-                printf (" %s", *w);
-            break;
+            if ((depth + 1) * sizeof *stack > size)
+                stack = checked_grow_alloc (stack, &size);
+            stack[depth].node = child;
+            stack[depth].indent = child_indent;
+            stack[depth].stage = 0;
+            depth++;
+            continue;
         }
-            
-        case SUBSHELL_COMMAND:
-            printf ("%*s(\n", indent, "");
-            command_indented_print (indent + 1, c->u.subshell_command);
-            printf ("\n%*s)", indent, "");
-            break;
-            
-        default:
-            abort ();
+
+        // The node is done.
+        if (c->input[n])
+            printf ("<%s", c->word[c->input[n]]);
+        if (c->output[n])
+            printf (">%s", c->word[c->output[n]]);
+        depth--;
     }
-    
-    if (c->input)
-        printf ("<%s", c->input);
-    if (c->output)
-        printf (">%s", c->output);
+
+    free (stack);
 }
 
 void
 print_command (command_t c)
 {
-    command_indented_print (2, c);
+    command_indented_print (2, c, c->root);
     putchar ('\n');
 }
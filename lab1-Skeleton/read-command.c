@@ -3,213 +3,189 @@
 #include "command-internals.h"
 #include "command.h"
 #include "alloc.h"
+#include "char-class.h"
 #include <stdio.h>
 #include <ctype.h>
 #include <stdlib.h>
 #include <getopt.h>
 #include <errno.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
 /* FIXME: You may need to add #include directives, macro definitions,
  static function definitions, etc.  */
 
-bool isValidChar(char character){
-    if (isalpha(character) || isdigit(character) || character == '!' ||
-        character == '%' || character == '+' || character == ',' ||
-        character == '-' || character == '.' || character == '/' ||
-        character == ':' || character == '@' || character == '^' ||
-        character == '_' ) {
-        return true;
-    } else {
-        return false;
-    }
-}
+/////////////////////////TOKENS//////////////////////////////
+//  the lexer turns each complete command into an array of //
+//  tokens; make_command_tree builds the tree from them    //
 
-enum char_type
+enum token_type
 {
-    REGULAR_CHAR,           //0
-    TOKEN_CHAR,             //1
-    NEWLINE_CHAR,           //2
-    HASHTAG_CHAR,           //3
-    WHITESPACE_CHAR,        //4
-    INVALID_CHAR,           //5
+    WORD_TOKEN,
+    SEMICOLON_TOKEN,        // ';', or a newline standing in for one
+    BACKGROUND_TOKEN,       // & (the lexer adds a ';' after it if a command follows)
+    AND_TOKEN,              // &&
+    OR_TOKEN,               // ||
+    PIPE_TOKEN,             // |
+    LEFT_PAREN_TOKEN,       // (
+    RIGHT_PAREN_TOKEN,      // )
+    INPUT_TOKEN,            // <
+    OUTPUT_TOKEN,           // >
 };
 
-enum char_type identify_char_type(char character) {
-    
-    //REGULAR CHARACTER
-    if (isalpha(character) || isdigit(character) || character == '!' ||
-        character == '%' || character == '+' || character == ',' ||
-        character == '-' || character == '.' || character == '/' ||
-        character == ':' || character == '@' || character == '^' ||
-        character == '_' ) {
-        return REGULAR_CHAR;
-    }
-    //TOKEN CHARACTER
-    else if (character == '|' || character == '&' ||
-             character == ';' || character == '(' || character == ')' ||
-             character == '<' || character == '>'  )
-        return TOKEN_CHAR;
-    
-    //NEWLINE CHARACTER
-    else if (character == '\n')
-        return NEWLINE_CHAR;
-    
-    //HASHTAG CHAR
-    else if (character=='#')
-        return HASHTAG_CHAR;
-    
-    //WHITESPACE
-    else if (character==' ')
-        return WHITESPACE_CHAR;
-    
-    //if none of the above, it is invalid
-    else return INVALID_CHAR;
-    
+struct token
+{
+    enum token_type type;
+
+    // for WORD_TOKEN: the word's characters in the script (not '\0'-terminated)
+    char const *start;
+    size_t length;
+};
+
+struct token_list
+{
+    struct token *tokens;   // NULL if tokens are only being counted
+    size_t count;
+    size_t size;            // bytes allocated for tokens
+};
+
+//the shunting-yard stacks: node numbers waiting to be operands, and
+//operators ('(' included) waiting for their operands.  neither can hold
+//more entries than the tree has tokens, so they are grown to that size
+//once and then reused for every tree
+struct parse_stacks
+{
+    uint32_t *operands;
+    enum token_type *operators;
+    size_t capacity;        // entries each can hold
+};
+
+////////////////////////////TREES/////////////////////////////
+//  a tree is one block: parallel node arrays plus its words //
+
+command_t alloc_command_tree(uint32_t num_nodes, uint32_t num_words, size_t text_size, char **text) {
+
+    //widest members first, so each array is aligned
+    size_t size = sizeof(struct command)
+                + num_words * sizeof(char *)
+                + num_nodes * (sizeof(uint32_t[2]) + 2 * sizeof(uint32_t) + 1)
+                + text_size;
+    command_t tree = checked_malloc(size);
+    char *p = (char *) (tree + 1);
+
+    tree->word = (char **) p;
+    p += num_words * sizeof(char *);
+    tree->child = (uint32_t (*)[2]) p;
+    p += num_nodes * sizeof(uint32_t[2]);
+    tree->input = (uint32_t *) p;
+    p += num_nodes * sizeof(uint32_t);
+    tree->output = (uint32_t *) p;
+    p += num_nodes * sizeof(uint32_t);
+    tree->type = (unsigned char *) p;
+    p += num_nodes;
+    *text = p;
+
+    tree->status = -1;
+    tree->tree_number = 0;
+    tree->refs = 1;
+    tree->root = num_nodes - 1;
+    tree->num_nodes = num_nodes;
+    tree->word[0] = NULL;
+    tree->arena = NULL;
+    return tree;
 }
 
+//a tree being built from tokens; nodes and words are handed out in order
+struct tree_builder {
+    command_t tree;
+    uint32_t next_node;
+    uint32_t next_word;
 
-//make word**
-char** make_word(char *simple_command, int num_words){
-    
-    char **words = (char**)(checked_malloc((num_words+1) * sizeof(char*)));
-    memset (words, '\0', (num_words+1) * sizeof(char*));
-    
-    //counters
-    int pointer_array_pos = 0;
-    int word_array_pos = 0;
-    int word_character_count = 0;
-    int i = 0;
-    
-    //traversing through simple_command
-    while (simple_command[i] != '\0' && simple_command[i] != '<' && simple_command[i] != '>'){
-        if (simple_command[i] == ' '){
-            
-            //ake a new string in memory
-            char *new_word = (char*) checked_malloc((i+1)*sizeof(char));
-            memset(new_word, '\0', (i+1)*sizeof(char));
-            
-            //add word to second array
-            int j;
-            for (j=0; j<word_character_count;j++){
-                new_word[j] =simple_command[word_array_pos];
-                word_array_pos++;
-            }
-            
-            //make our wordlist point to a new string
-            words[pointer_array_pos] = new_word;
-            
-            //increment counters
-            word_array_pos++;
-            pointer_array_pos++;
-            
-            word_character_count=0;
-        }
-        //continute looking for words
-        if (simple_command[i] != ' '){
-            word_character_count++;
-        }
-        
-        i++;
-    }//end traversal through simple_command
-    
-    //make a new string in memory
-    char *new_word = checked_malloc((i+1)*sizeof(char));
-    memset(new_word, '\0', (i+1)*sizeof(char));
-    
-    //add word to second array
-    int j;
-    for (j=0; j<word_character_count;j++){
-        new_word[j] =simple_command[word_array_pos];
-        word_array_pos++;
+    //where copied words go, unless words stay in place in the script
+    char *text;
+    bool words_in_place;
+
+    //the stacks, borrowed from the caller
+    uint32_t *operands;
+    size_t num_operands;
+    enum token_type *operators;
+    size_t num_operators;
+};
+
+//add a word token to the tree's words and return its index.  in place,
+//the word is ended with a '\0' right where it sits in the script (the
+//lexer is done with the byte after it); otherwise it is copied
+static uint32_t add_word(struct tree_builder *b, struct token const *word) {
+    char *text;
+    if (b->words_in_place) {
+        text = (char *) word->start;
+    } else {
+        text = b->text;
+        memcpy(text, word->start, word->length);
+        b->text += word->length + 1;
     }
-    
-    //make our wordlist point to a new string
-    words[pointer_array_pos] = new_word;
-    
-    return words;
+    text[word->length] = '\0';
+
+    b->tree->word[b->next_word] = text;
+    return b->next_word++;
 }
 
-command_t createCommand(enum command_type new_cmd, char *command_string) {
-    
-    
-    command_t x = (command_t) checked_malloc(sizeof(*x));
-    x->type = new_cmd;
-    x->status = -1;
-    x->input = 0;
-    x->output = 0;
-    x->tree_number = 0;
-    
-    
-    switch (new_cmd) {
-        case SIMPLE_COMMAND:
-        {
-            int i=0;
-            int white_space_counter = 0;
-            while (command_string[i] != '\0' && command_string[i] != '<' && command_string[i] != '>'){
-                if (command_string[i] == ' '){
-                    white_space_counter++;
-                }
-                i++;
-            }
-            
-            //number of words in simple command = white space + 1
-            //malloc appropriate memory
-            x->u.word = checked_malloc((white_space_counter+1) * sizeof(char*));
-            memset(x->u.word, '\0', (white_space_counter+1)*sizeof(char*));
-            
-            //WARNING: How do you make a union return a certain item?
-            x->u.word = make_word(command_string, white_space_counter+1);
-            break;
-        }
-            
-        case AND_COMMAND:
-            //set both pointers to null to initialize
-            x->u.command[0] = '\0';
-            x->u.command[1] = '\0';
-            break;
-        case SEQUENCE_COMMAND:
-            x->u.command[0] = '\0';
-            x->u.command[1] = '\0';
-            break;
-        case OR_COMMAND:
-            x->u.command[0] = '\0';
-            x->u.command[1] = '\0';
-            break;
-        case PIPE_COMMAND:
-            x->u.command[0] = '\0';
-            x->u.command[1] = '\0';
-            break;
-        case SUBSHELL_COMMAND:
-        {
-            x->u.subshell_command = NULL;
-            break;
-        }
-        default:
-            break;
+static uint32_t new_node(struct tree_builder *b, enum command_type type) {
+    uint32_t n = b->next_node++;
+    b->tree->type[n] = type;
+    b->tree->input[n] = 0;
+    b->tree->output[n] = 0;
+    b->tree->child[n][0] = 0;
+    b->tree->child[n][1] = 0;
+    return n;
+}
+
+static int getPrecedence(enum token_type type) {
+
+    if (type == SEMICOLON_TOKEN) {
+        return 1;
     }
-    
-    return x;
+    else if (type == OR_TOKEN || type == AND_TOKEN) {
+        return 2;
+    }
+    else if (type == PIPE_TOKEN) {
+        return 3;
+    }
+
+    return -1;
+
 }
 
+enum command_type operatorCommandType(enum token_type type) {
 
-///////////////////////COMMAND NODE///////////////////////////////
-//  command node is used in both the stack and the linked list. //
+    switch (type) {
+        case AND_TOKEN:
+            return AND_COMMAND;
+        case OR_TOKEN:
+            return OR_COMMAND;
+        case PIPE_TOKEN:
+            return PIPE_COMMAND;
+        default:
+            return SEQUENCE_COMMAND;
+    }
+}
 
+//pop the top operator and its two operands, and push the node combining them
+static void combine_commands(struct tree_builder *b) {
+    enum token_type op = b->operators[--b->num_operators];
+    uint32_t right = b->operands[--b->num_operands];
+    uint32_t left = b->operands[--b->num_operands];
 
-commandNode_t createNode(enum command_type new_cmd){
-    commandNode_t x = (commandNode_t) checked_malloc(sizeof(*x));
-    x->next = NULL;
-    x->prev = NULL;
-    x->write_list = NULL;
-    x->read_list = NULL;
-    x->tree_number = 0;
-    x->command_tree_done_executing=false;
-    x->dependencies_done = false;
-    x->command_tree_begun_executing = false;
-    x->dependency_list=checked_malloc(sizeof(commandNode_t));
-    return x;
+    uint32_t n = new_node(b, operatorCommandType(op));
+    b->tree->child[n][0] = left;
+    b->tree->child[n][1] = right;
+    b->operands[b->num_operands++] = n;
 }
 
+///////////////////////COMMAND NODE///////////////////////////////
+//  command node holds a tree in the stream's linked list       //
+
 commandNode_t createNodeFromCommand(command_t new_command){
     commandNode_t x = (commandNode_t) checked_malloc(sizeof(*x));
     x->cmd = new_command;
@@ -217,368 +193,159 @@ commandNode_t createNodeFromCommand(command_t new_command){
     x->prev = NULL;
     x->write_list = NULL;
     x->read_list = NULL;
-    x->tree_number = 0;
+    x->tree_number = new_command->tree_number;
     x->command_tree_done_executing = false;
     x->dependencies_done = false;
     x->command_tree_begun_executing = false;
-    x->dependency_list=checked_malloc(sizeof(commandNode_t));
-    
-    return x;
-}
+    x->dependency_list = NULL;
 
-
-enum command_type getNodeType(commandNode_t node)
-{
-    return node->cmd->type;
-}
-
-
-/////////////////////////COMMAND STACK///////////////////////
-//  implemented using a linked list of commandNodes        //
-
-struct commandStack{
-    commandNode_t bottom;
-    commandNode_t top;
-};
-
-
-commandStack_t createStack(){
-    commandStack_t x = (commandStack_t) checked_malloc(sizeof(*x));
-    x->bottom = NULL;
-    x->top = NULL;
     return x;
 }
 
 
+//////////////////////COMMAND STREAM/////////////////////
+// command_stream is a linked list of commandNodes     //
 
-void stackPush(commandStack_t stack, commandNode_t newNode){
-    if (stack->bottom == NULL){
-        stack->bottom = newNode;
-        stack->top = newNode;
-        stack->bottom->prev = NULL;
-        stack->top->prev = NULL;
-    } else {
-        newNode->prev = stack->top;
-        stack->top->next = newNode;
-        stack->top = newNode;
-    }
-}
+//plant a tree. soon it will become part of a forest
+//the tokens have already been checked by the lexer, so this never fails.
+//the tree is sized from the tokens up front and filled in one pass;
+//with words_in_place, words point into the script instead of being copied.
+//the tree is the only allocation, unless STACKS must grow
+command_t make_command_tree(struct token const *tokens, size_t num_tokens, bool words_in_place, struct parse_stacks *stacks){
 
-commandNode_t stackPop(commandStack_t stack){
-    if (stack->bottom == NULL){
-        return NULL;
-    }
-    
-    commandNode_t poppedNode = stack->top;
-    
-    if (stack->top->prev != NULL) {
-        stack->top = stack->top->prev;
-        stack->top->next = NULL;
-    }
-    else {
-        stack->top = NULL;
-        stack->bottom = NULL;
+    //count the nodes and words: each simple command, operator and '('
+    //makes a node, and each simple command's words end with a NULL
+    uint32_t num_nodes = 0;
+    uint32_t num_words = 1;
+    size_t text_size = 0;
+    size_t pos;
+    for (pos = 0; pos < num_tokens; pos++) {
+        enum token_type type = tokens[pos].type;
+        if (type == WORD_TOKEN) {
+            num_words++;
+            if (!words_in_place)
+                text_size += tokens[pos].length + 1;
+            //a word after a word or a redirection is not a new command
+            if (pos == 0 || tokens[pos-1].type == SEMICOLON_TOKEN || tokens[pos-1].type == AND_TOKEN ||
+                tokens[pos-1].type == OR_TOKEN || tokens[pos-1].type == PIPE_TOKEN || tokens[pos-1].type == LEFT_PAREN_TOKEN) {
+                num_nodes++;
+                num_words++;
+            }
+        } else if (type != RIGHT_PAREN_TOKEN && type != INPUT_TOKEN && type != OUTPUT_TOKEN) {
+            num_nodes++;
+        }
     }
-    
-    poppedNode->next = NULL;
-    poppedNode->prev = NULL;
-    return poppedNode;
-}
-
-commandNode_t getTop(commandStack_t stack){
-    return stack->top;
-}
 
-//checks if given string is a valid word
-int isWord(char *word){
-    int counter = 0;
-    while (word[counter] != '\0')
-    {
-        if (isalpha(word[counter]) || isdigit(word[counter]) || word[counter] == '!' ||
-            word[counter] == '%' || word[counter] == '+' || word[counter] == ',' ||
-            word[counter] == '-' || word[counter] == '.' || word[counter] == '/' ||
-            word[counter] == ':' || word[counter] == '@' || word[counter] == '^' ||
-            word[counter] == '_')
-        {
-            counter++;
-        } else {
-            return 0;
-        }
+    struct tree_builder builder;
+    struct tree_builder *b = &builder;
+    b->tree = alloc_command_tree(num_nodes, num_words, text_size, &b->text);
+    b->next_node = 0;
+    b->next_word = 1;
+    b->words_in_place = words_in_place;
+    if (stacks->capacity < num_tokens) {
+        while (stacks->capacity < num_tokens)
+            stacks->capacity = stacks->capacity ? 2 * stacks->capacity : 64;
+        stacks->operands = checked_realloc(stacks->operands, stacks->capacity * sizeof(uint32_t));
+        stacks->operators = checked_realloc(stacks->operators, stacks->capacity * sizeof(enum token_type));
     }
-    return 1;
-}
+    b->operands = stacks->operands;
+    b->num_operands = 0;
+    b->operators = stacks->operators;
+    b->num_operators = 0;
+    command_t tree = b->tree;
 
+    pos = 0;
 
-bool isOperator(char character) {
-    
-    if (character == '|' || character == '&' || character == ';') {
-        return true;
-    }
-    else return false;
-}
+    while (pos < num_tokens){
 
-int getPrecedence(commandNode_t operator) {
-    
-    if (operator->cmd->type == SEQUENCE_COMMAND) {
-        return 1;
-    }
-    else if (operator->cmd->type == OR_COMMAND || operator->cmd->type == AND_COMMAND) {
-        return 2;
-    }
-    else if (operator->cmd->type == PIPE_COMMAND) {
-        return 3;
-    }
-    
-    return -1;
-    
-}
+        struct token const *tok = &tokens[pos];
 
-commandNode_t combine_commands(commandNode_t operator, commandNode_t top_operand, commandNode_t bot_operand) {
-    
-    command_t c1 = bot_operand->cmd;
-    command_t c2 = top_operand->cmd;
-    
-    operator->cmd->u.command[0] = c1;
-    operator->cmd->u.command[1] = c2;
-    
-    //assume that this doesnt kill the commands
-    free(top_operand);
-    free(bot_operand);
-    
-    return operator;
-    
-}
+        //If a simple command, push it onto the operand stack
+        if (tok->type == WORD_TOKEN){
 
-//////////////////////COMMAND STREAM/////////////////////
-// command_stream is a linked list of commandNodes     //
+            uint32_t n = new_node(b, SIMPLE_COMMAND);
+            tree->child[n][0] = b->next_word;
 
-//plant a tree. soon it will become part of a forest
-command_t make_command_tree(char *complete_command){
-    commandStack_t command_stack = createStack();
-    commandStack_t operator_stack = createStack();
-    
-    int buff_pos = 0;
-    char buff_char = '\0';
-    
-    //char array to store simple commands as they come
-    
-    int simple_command_pos = 0;
-    
-    /*
-     REGULAR_CHAR,           //0
-     TOKEN_CHAR,             //1
-     WHITESPACE_CHAR,        //4
-     */
-    while ((buff_char = complete_command[buff_pos]) != '\0'){
-        
-        //If a simple command, push it onto a command stack
-        if (identify_char_type(buff_char) == REGULAR_CHAR){
-            
-            char *simple_command = checked_malloc(1024 * sizeof(char));
-            memset(simple_command, '\0', 1024 * sizeof(char));
-            
-            //add first valid character, and then add rest of the characters and whitespace in the simple command
-            while (identify_char_type(buff_char) == REGULAR_CHAR || identify_char_type(buff_char) == WHITESPACE_CHAR /*||buff_char == '<' || buff_char == '>'*/){
-                
-                simple_command[simple_command_pos] = buff_char;
-                simple_command_pos++;
-                
-                buff_pos++;
-                buff_char = complete_command[buff_pos];
-                
+            //every word up to the next token belongs to this simple command
+            while (pos < num_tokens && tokens[pos].type == WORD_TOKEN){
+                add_word(b, &tokens[pos]);
+                pos++;
             }
-            
-            command_t new_cmd = createCommand(SIMPLE_COMMAND, simple_command);
-            commandNode_t new_node = createNodeFromCommand(new_cmd);
-            stackPush(command_stack, new_node);
-            
-            simple_command_pos =0;
-            
-            continue;
-        }
-        
-        if (buff_char == '(') {
-            command_t new_cmd = createCommand(SUBSHELL_OPEN, NULL);
-            commandNode_t new_node = createNodeFromCommand(new_cmd);
-            stackPush(operator_stack, new_node);
-            buff_pos++;
+            tree->word[b->next_word++] = NULL;
+
+            b->operands[b->num_operands++] = n;
             continue;
         }
-        
-        if (buff_char == '<') {
-            
-            //get the filename
-            int k = buff_pos+1;
-            int filename_startpos = k;
-            while (complete_command[k] != '\0' && complete_command[k] != '>' && isOperator(complete_command[k]) != true && complete_command[k]!= ')') {
-                k++;
-            }
-            
-            int input_filename_size = k-filename_startpos;
-            char* input_filename = (char*) checked_malloc((input_filename_size+1) * sizeof(char));
-            memset(input_filename, '\0', (input_filename_size+1) * sizeof(char));
-            int filename_pos =0;
-            int l;
-            for (l = filename_startpos; l<k; l++) {
-                input_filename[filename_pos] = complete_command[l];
-                filename_pos++;
+
+        //'&' applies to everything back to the last ';' or '(', so finish
+        //that off and run it in the background
+        if (tok->type == BACKGROUND_TOKEN) {
+            while (b->num_operators > 0 && b->operators[b->num_operators-1] != LEFT_PAREN_TOKEN &&
+                   getPrecedence(b->operators[b->num_operators-1]) > getPrecedence(SEMICOLON_TOKEN)) {
+                combine_commands(b);
             }
-            
-            //if we're here we've read in the filename
-            
-            getTop(command_stack)->cmd->input = input_filename;
-            buff_pos=k;
+
+            uint32_t background = new_node(b, BACKGROUND_COMMAND);
+            tree->child[background][0] = b->operands[b->num_operands-1];
+            b->operands[b->num_operands-1] = background;
+
+            pos++;
             continue;
         }
-        
-        if (buff_char=='>') {
-            
-            int k = buff_pos+1;
-            int filename_startpos = k;
-            while (complete_command[k] != '\0' && isOperator(complete_command[k]) != true && complete_command[k]!= ')') {
-                k++;
-            }
-            
-            int input_filename_size = k-filename_startpos;
-            char* output_filename = (char*) checked_malloc((input_filename_size+1) * sizeof(char));
-            memset(output_filename, '\0', (input_filename_size+1) * sizeof(char));
-            int filename_pos =0;
-            int l;
-            for (l = filename_startpos; l<k; l++) {
-                output_filename[filename_pos] = complete_command[l];
-                filename_pos++;
-            }
-            
-            //if we're here, we've read in the full filename.
-            getTop(command_stack)->cmd->output = output_filename;
-            buff_pos=k;
+
+        if (tok->type == LEFT_PAREN_TOKEN) {
+            b->operators[b->num_operators++] = LEFT_PAREN_TOKEN;
+            pos++;
             continue;
-            
         }
-        
-        if (isOperator(buff_char) && operator_stack->top == NULL) {
-            if (buff_char == '&') {
-                command_t new_cmd = createCommand(AND_COMMAND, NULL);
-                commandNode_t new_node = createNodeFromCommand(new_cmd);
-                stackPush(operator_stack, new_node);
-                buff_pos+=2;
-                continue;
-            }
-            else if (buff_char == '|') {
-                if (complete_command[buff_pos+1] == '|') {
-                    command_t new_cmd = createCommand(OR_COMMAND, NULL);
-                    commandNode_t new_node = createNodeFromCommand(new_cmd);
-                    stackPush(operator_stack, new_node);
-                    buff_pos+=2;
-                    continue;
-                }
-                else {
-                    command_t new_cmd = createCommand(PIPE_COMMAND, NULL);
-                    commandNode_t new_node = createNodeFromCommand(new_cmd);
-                    stackPush(operator_stack, new_node);
-                    buff_pos++;
-                    continue;
-                }
-            }
-            else if (buff_char == ';') {
-                command_t new_cmd = createCommand(SEQUENCE_COMMAND, NULL);
-                commandNode_t new_node = createNodeFromCommand(new_cmd);
-                stackPush(operator_stack, new_node);
-                buff_pos++;
-                continue;
-            }
+
+        //the filename is the word token after the redirection
+        if (tok->type == INPUT_TOKEN) {
+            tree->input[b->operands[b->num_operands-1]] = add_word(b, &tokens[pos+1]);
+            pos += 2;
+            continue;
         }
-        
-        if (isOperator(buff_char) && operator_stack->top !=NULL) {
-            
-            command_t new_cmd;
-            commandNode_t new_node;
-            
-            if (buff_char == '&') {
-                new_cmd = createCommand(AND_COMMAND, NULL);
-                new_node = createNodeFromCommand(new_cmd);
-                buff_pos+=2;
-            }
-            else if (buff_char == '|') {
-                if (complete_command[buff_pos+1] == '|') {
-                    new_cmd = createCommand(OR_COMMAND, NULL);
-                    new_node = createNodeFromCommand(new_cmd);
-                    buff_pos+=2;
-                }
-                else {
-                    new_cmd = createCommand(PIPE_COMMAND, NULL);
-                    new_node = createNodeFromCommand(new_cmd);
-                    buff_pos++;
-                }
-            }
-            else { //(buff_char == ';') {
-                new_cmd = createCommand(SEQUENCE_COMMAND, NULL);
-                new_node = createNodeFromCommand(new_cmd);
-                buff_pos++;
-            }
-            
-            while ( getTop(operator_stack) != NULL && (getPrecedence(new_node) <= getPrecedence(getTop(operator_stack))) && getTop(operator_stack)->cmd->type != SUBSHELL_OPEN ) {
-                commandNode_t popped = stackPop(operator_stack);
-                commandNode_t operand1 = stackPop(command_stack);
-                commandNode_t operand2 = stackPop(command_stack);
-                
-                //combine and then push onto stack
-                commandNode_t combined_command = combine_commands(popped, operand1, operand2);
-                stackPush(command_stack, combined_command);
-                
-            }
-            
-            stackPush(operator_stack, new_node);
+
+        if (tok->type == OUTPUT_TOKEN) {
+            tree->output[b->operands[b->num_operands-1]] = add_word(b, &tokens[pos+1]);
+            pos += 2;
             continue;
-            
         }
-        
-        if (buff_char == ')') {
-            
-            commandNode_t poppedOperator;
-            while ( ((poppedOperator = stackPop(operator_stack))->cmd->type) != SUBSHELL_OPEN  ) {
-                
-                commandNode_t operand1 = stackPop(command_stack);
-                commandNode_t operand2 = stackPop(command_stack);
-                
-                //combine and then push onto stack
-                commandNode_t combined_command = combine_commands(poppedOperator, operand1, operand2);
-                stackPush(command_stack, combined_command);
-                
+
+        if (tok->type == RIGHT_PAREN_TOKEN) {
+
+            while (b->operators[b->num_operators-1] != LEFT_PAREN_TOKEN) {
+                combine_commands(b);
             }
-            
-            //at this point the popped operator should be a SUBSHELL_OPEN; get rid of it
-            free(poppedOperator);
-            
-            command_t new_subshell = createCommand(SUBSHELL_COMMAND, NULL);
-            new_subshell->u.subshell_command = stackPop(command_stack)->cmd;
-            commandNode_t new_subshell_node = createNodeFromCommand(new_subshell);
-            stackPush(command_stack, new_subshell_node);
-            
-            buff_pos++;
+
+            //at this point the top operator is the '('; get rid of it
+            b->num_operators--;
+
+            uint32_t subshell = new_node(b, SUBSHELL_COMMAND);
+            tree->child[subshell][0] = b->operands[b->num_operands-1];
+            b->operands[b->num_operands-1] = subshell;
+
+            pos++;
             continue;
         }
-        
-        
-        
-        //buff_pos++;
-    } //end of buff_char while loop
-    
-    while (operator_stack -> top != NULL) {
-        commandNode_t popped = stackPop(operator_stack);
-        commandNode_t operand1 = stackPop(command_stack);
-        commandNode_t operand2 = stackPop(command_stack);
-        
-        //combine and then push onto stack
-        commandNode_t combined_command = combine_commands(popped, operand1, operand2);
-        stackPush(command_stack, combined_command);
-        
-    }
-    
-    return getTop(command_stack)->cmd;
-}
 
+        //otherwise it is an operator: ';', '&&', '||' or '|'
+        while ( b->num_operators > 0 && (getPrecedence(tok->type) <= getPrecedence(b->operators[b->num_operators-1])) && b->operators[b->num_operators-1] != LEFT_PAREN_TOKEN ) {
+            combine_commands(b);
+        }
+
+        b->operators[b->num_operators++] = tok->type;
+        pos++;
+
+    } //end of token while loop
+
+    while (b->num_operators > 0) {
+        combine_commands(b);
+    }
 
+    tree->root = b->operands[0];
+    return tree;
+}
 
 command_stream_t initStream(){
     command_stream_t new_stream = (command_stream_t) checked_malloc(sizeof(*new_stream));
@@ -588,6 +355,7 @@ command_stream_t initStream(){
     new_stream->blocked_commands = checked_malloc(sizeof(commandNode_t));
     memset(new_stream->blocked_commands, '\0', sizeof(commandNode_t));
     new_stream->num_nodes = 0;
+    new_stream->reader = NULL;
     return new_stream;
 }
 
@@ -610,625 +378,890 @@ void addNodeToStream(command_stream_t cs_stream, commandNode_t new_node) {
     
 }
 
-bool isTokenChar(char character) {
-    
-    if (character == '|' || character == '&' ||
-        character == ';' || character == '(' || character == ')' ||
-        character == '<' || character == '>'  )
-        return true;
-    else return false;
-    
+
+////////////////////////////LEXER////////////////////////////
+//  one pass over the script: split it into tokens and     //
+//  check the grammar with a small state machine           //
+
+//cursor over an in-memory script; the lexer reads it in place
+struct byte_cursor {
+    char const *pos;
+    char const *end;
+};
+
+//state for parsing a script lazily, one complete command at a time
+struct command_reader {
+    struct byte_cursor input;
+    int line;
+    int next_tree_number;
+
+    //token array and parse stacks, reused for every complete command
+    struct token_list tokens;
+    struct parse_stacks stacks;
+
+    //true if words may be ended in place in the (writable) script
+    bool words_in_place;
+
+    //where the script starts, for command_stream_position
+    char const *script_start;
+
+    //for a streamed script: where more of it comes from, either the file
+    //descriptor FD (-1 if none) or get_next_byte, and whether it has run
+    //out.  both are unset if the whole script is in memory
+    int fd;
+    int (*get_next_byte)(void *);
+    void *get_next_byte_argument;
+    bool at_eof;
+
+    //whether the command tokenized last was ended by a blank line, so
+    //nothing after it need be read before it runs
+    bool at_blank_line;
+
+    //the buffer a streamed script is read into, or NULL if the whole
+    //script is in memory, and its size in bytes
+    char *owned_script;
+    size_t owned_size;
+
+    //the syntax error that stopped the lexer, if any
+    int error_line;
+    char error_message[64];
+};
+
+enum lexer_state
+{
+    EXPECT_COMMAND,         // need a word or '(': at the start, after an operator or after '('
+    IN_SIMPLE_COMMAND,      // after a word; more words may follow
+    EXPECT_INPUT_FILE,      // after '<'
+    EXPECT_OUTPUT_FILE,     // after '>'
+    AFTER_INPUT,            // after "<file"; only '>' may still follow
+    AFTER_OUTPUT,           // after ">file"
+    AFTER_SUBSHELL,         // after ')'; '<' and '>' may follow
+    AFTER_BACKGROUND,       // after '&'; a new command may follow
+};
+
+//record a syntax error at the current line; the lexer then gives up
+static int syntax_error(struct command_reader *reader, char const *message) {
+    reader->error_line = reader->line;
+    snprintf(reader->error_message, sizeof(reader->error_message), "Invalid syntax: %s", message);
+    return -1;
 }
 
+//report the error that stopped READER, whose line numbers are off by LINE_OFFSET
+static void report_syntax_error(struct command_reader const *reader, int line_offset) {
+    fprintf(stderr, "%d: %s\n", reader->error_line + line_offset, reader->error_message);
+    exit(1);
+}
 
-bool isValidToken(char first, char second) {
-    
-    
-    switch (first) {
-        case ';':
-            if (!isTokenChar(second))
-                return true;
-            break;
-        case '|':
-            if (isTokenChar(second) && first == second)
-                return true;
-            break;
-        case  '&':
-            if (isTokenChar(second) && first == second)
-                return true;
-            break;
-        case '(':
-            if (!isTokenChar(second))
-                return true;
-            break;
+static void add_token(struct token_list *list, enum token_type type, char const *start, size_t length) {
+    //a syntax check needs only to know that there were tokens
+    if (list->tokens == NULL) {
+        list->count++;
+        return;
     }
-    return false;
+
+    if ((list->count + 1) * sizeof(struct token) > list->size)
+        list->tokens = checked_grow_alloc(list->tokens, &list->size);
+
+    struct token *tok = &list->tokens[list->count++];
+    tok->type = type;
+    tok->start = start;
+    tok->length = length;
 }
 
+//could the command end in this state?
+static bool command_is_complete(enum lexer_state state) {
+    return state == IN_SIMPLE_COMMAND || state == AFTER_INPUT ||
+           state == AFTER_OUTPUT || state == AFTER_SUBSHELL ||
+           state == AFTER_BACKGROUND;
+}
 
-void eatWhiteSpaces(char *buffer, int bufferSize, char *newArray){
-    bool foundWord = false;
-    int newArrayPos = 0;
-    //memset(newArray, '\0', bufferSize * sizeof(char));
-    int i;
-    for (i = 0; i < bufferSize; i++){
-        
-        if (buffer[i] == ' '){
-            //if we have a valid word before the space
-            if (foundWord == false){
-                continue;
-            } else { //if we do have a word on the left of the white space
-                
-                //eat whitespaces, when we break out, we will have a character
-                while (buffer[i] == ' '){
-                    i++;
-                }
-                
-                /*
-                 REGULAR_CHAR,           //0
-                 TOKEN_CHAR,             //1
-                 NEWLINE_CHAR,           //2
-                 HASHTAG_CHAR,           //3
-                 WHITESPACE_CHAR,        //4
-                 INVALID_CHAR,           //5
-                 */
-                if (identify_char_type(buffer[i])==REGULAR_CHAR ||
-                    identify_char_type(buffer[i])==INVALID_CHAR){
-                    //add space, and then add character
-                    newArray[newArrayPos] = ' ';
-                    newArrayPos++;
-                    newArray[newArrayPos] = buffer[i];
-                    newArrayPos++;
-                } else if (identify_char_type(buffer[i])==TOKEN_CHAR){
-                    newArray[newArrayPos] = buffer[i];
-                    newArrayPos++;
-                    foundWord=false;
-                } else if (identify_char_type(buffer[i])==NEWLINE_CHAR){
-                    //i++;
-                } else if (identify_char_type(buffer[i])==HASHTAG_CHAR){
-                    i++;
-                }
-            }
-            
-        } else if(identify_char_type(buffer[i])==REGULAR_CHAR ||
-                  identify_char_type(buffer[i])==INVALID_CHAR){
-            foundWord = true;
-            newArray[newArrayPos] = buffer[i];
-            newArrayPos++;
-        } else if(identify_char_type(buffer[i])==TOKEN_CHAR){
-            foundWord = false;
-            newArray[newArrayPos] = buffer[i];
-            newArrayPos++;
-        } else if (identify_char_type(buffer[i])==HASHTAG_CHAR){
-            i++;
-            foundWord = false;
-        } else if (identify_char_type(buffer[i])==NEWLINE_CHAR){
-            foundWord = false;
+/*
+ Read the next complete command from READER's input into its tokens,
+ checking its syntax in the same pass.  A complete command ends at a blank
+ line (two or more newlines after a complete command) or at the end of the
+ input; a single newline after a complete command acts as ';'.  Return 1
+ for a command, 0 if there are no more commands, or -1 after recording a
+ syntax error in READER.
+ */
+static int tokenize_complete_command(struct command_reader *reader) {
+
+    struct byte_cursor *input = &reader->input;
+    int *line = &reader->line;
+    struct token_list *tokens = &reader->tokens;
+
+    enum lexer_state state = EXPECT_COMMAND;
+    int open_parens = 0;
+    int newlines = 0;       //newlines seen since the last complete command
+
+    tokens->count = 0;
+    reader->at_blank_line = false;
+
+    while (input->pos < input->end) {
+
+        char c = *input->pos;
+        enum char_type type = identify_char_type(c);
+
+        if (type == WHITESPACE_CHAR) {
+            input->pos = skip_spaces(input->pos, input->end);
+            continue;
         }
-    }
-    return;
-}
 
-//make sure the '&' character comes in pairs
-void checkAndSyntax(char* complete_command) {
-    
-    int pos=0;
-    while (complete_command[pos] != '\0') {
-        
-        //check for valid syntax
-        //make sure & comes in pairs
-        
-        if (complete_command[pos] == '&') {
-            pos++;
-            if (complete_command[pos] != '&') {
-                fprintf(stderr, "Invalid syntax: checkAndSyntax!");
-                exit(1);
+        //comments run to the end of the line
+        if (type == HASHTAG_CHAR) {
+            char const *newline = memchr(input->pos, '\n', input->end - input->pos);
+            input->pos = newline ? newline : input->end;
+            continue;
+        }
+
+        //newlines only matter after a complete command; elsewhere
+        //(at the start, after an operator or after '(') they are skipped.
+        //a blank line ends the complete command at once, so a streamed
+        //script need not wait for whatever comes after it
+        if (type == NEWLINE_CHAR) {
+            input->pos++;
+            (*line)++;
+            if (command_is_complete(state) && ++newlines > 1) {
+                reader->at_blank_line = true;
+                break;
             }
+            continue;
         }
-        pos++;
-        
-    }
-    
-}
 
-//there can be no consecutive token characters
-//the exceptions: a '&' character must be followed immediately by another '&'
-//                a '|' character may be followed by a '|'
-//                tokens may be followed by an open paren '('
-void checkForConsecutiveTokens(char* complete_command) {
-    
-    int pos=0;
-    while(complete_command[pos] != '\0') {
-        
-        //there can be no consecutive token characters
-        if ( isTokenChar(complete_command[pos]) ) {
-            switch (complete_command[pos]) {
-                    
-                case '<': case '>': case ';':
-                    if ( complete_command[pos+1] == '<' || complete_command[pos+1] == '>' || complete_command[pos+1] == '|' || complete_command[pos+1] == '&' || complete_command[pos+1] == ';' || complete_command[pos+1] == ')' ) {
-                        fprintf(stderr, "Invalid syntax : checkForConsecutiveTokens!");
-                        exit(1);
-                    }
+        if (type == INVALID_CHAR) {
+            reader->error_line = *line;
+            snprintf(reader->error_message, sizeof(reader->error_message), "Invalid character: %c <---", c);
+            return -1;
+        }
+
+        //a single newline separates commands like ';'
+        if (newlines == 1) {
+            if (type != REGULAR_CHAR && c != '(')
+                return syntax_error(reader, "line starts with an operator");
+            add_token(tokens, SEMICOLON_TOKEN, NULL, 0);
+            state = EXPECT_COMMAND;
+            newlines = 0;
+        }
+
+        //a command right after '&' runs once the one before it has started
+        if (state == AFTER_BACKGROUND && (type == REGULAR_CHAR || c == '(')) {
+            add_token(tokens, SEMICOLON_TOKEN, NULL, 0);
+            state = EXPECT_COMMAND;
+        }
+
+        if (type == REGULAR_CHAR) {
+            char const *start = input->pos;
+            input->pos = skip_word_chars(input->pos, input->end);
+
+            switch (state) {
+                case EXPECT_COMMAND:
+                case IN_SIMPLE_COMMAND:
+                    state = IN_SIMPLE_COMMAND;
                     break;
-                case '&':
-                    pos++;
-                    if ( complete_command[pos+1] == '<' || complete_command[pos+1] == '>' || complete_command[pos+1] == '|' || complete_command[pos+1] == '&' || complete_command[pos+1] == ';' || complete_command[pos+1] == ')' ) {
-                        fprintf(stderr, "Invalid syntax : checkForConsecutiveTokens!");
-                        exit(1);
-                    }
+                case EXPECT_INPUT_FILE:
+                    state = AFTER_INPUT;
                     break;
-                case '|':
-                    if ( complete_command[pos+1] == '<' || complete_command[pos+1] == '>' || complete_command[pos+1] == '&' || complete_command[pos+1] == ';' || complete_command[pos+1] == ')' ) {
-                        fprintf(stderr, "Invalid syntax : checkForConsecutiveTokens!");
-                        exit(1);
-                    }
-                    
-                    if ( complete_command[pos+1] == '|' ) {
-                        pos++;
-                        if ( complete_command[pos+1] == '<' || complete_command[pos+1] == '>' || complete_command[pos+1] == '|' || complete_command[pos+1] == '&' || complete_command[pos+1] == ';' || complete_command[pos+1] == ')' ) {
-                            fprintf(stderr, "Invalid syntax : checkForConsecutiveTokens!");
-                            exit(1);
-                        }
-                    }
+                case EXPECT_OUTPUT_FILE:
+                    state = AFTER_OUTPUT;
                     break;
-                case '(':
-                    if ( complete_command[pos+1] == '<' || complete_command[pos+1] == '>' || complete_command[pos+1] == '|' || complete_command[pos+1] == '&' || complete_command[pos+1] == ';' ) {
-                        fprintf(stderr, "Invalid syntax : checkForConsecutiveTokens!");
-                        exit(1);
+                default:
+                    return syntax_error(reader, "word after a redirection or ')'");
+            }
+
+            add_token(tokens, WORD_TOKEN, start, input->pos - start);
+            continue;
+        }
+
+        //otherwise c is a token character
+        input->pos++;
+
+        switch (c) {
+            case '(':
+                if (state != EXPECT_COMMAND)
+                    return syntax_error(reader, "unexpected '('");
+                open_parens++;
+                add_token(tokens, LEFT_PAREN_TOKEN, NULL, 0);
+                break;
+
+            case ')':
+                if (!command_is_complete(state) || open_parens == 0)
+                    return syntax_error(reader, "unexpected ')'");
+                open_parens--;
+                state = AFTER_SUBSHELL;
+                add_token(tokens, RIGHT_PAREN_TOKEN, NULL, 0);
+                break;
+
+            case '<':
+                if (state != IN_SIMPLE_COMMAND && state != AFTER_SUBSHELL)
+                    return syntax_error(reader, "unexpected '<'");
+                state = EXPECT_INPUT_FILE;
+                add_token(tokens, INPUT_TOKEN, NULL, 0);
+                break;
+
+            case '>':
+                if (state != IN_SIMPLE_COMMAND && state != AFTER_SUBSHELL && state != AFTER_INPUT)
+                    return syntax_error(reader, "unexpected '>'");
+                state = EXPECT_OUTPUT_FILE;
+                add_token(tokens, OUTPUT_TOKEN, NULL, 0);
+                break;
+
+            default: {
+                //';', '&', '|', '||' or '&&'; each needs a command on its left
+                enum token_type op = SEMICOLON_TOKEN;
+                if (c == '&') {
+                    op = BACKGROUND_TOKEN;
+                    if (input->pos < input->end && *input->pos == '&') {
+                        input->pos++;
+                        op = AND_TOKEN;
                     }
-                    break;
-                default: // ')'
-                    break;
+                } else if (c == '|') {
+                    op = PIPE_TOKEN;
+                    if (input->pos < input->end && *input->pos == '|') {
+                        input->pos++;
+                        op = OR_TOKEN;
+                    }
+                }
+
+                if (!command_is_complete(state) || state == AFTER_BACKGROUND)
+                    return syntax_error(reader, "operator is missing its left operand");
+                state = op == BACKGROUND_TOKEN ? AFTER_BACKGROUND : EXPECT_COMMAND;
+                add_token(tokens, op, NULL, 0);
+                break;
             }
         }
-        pos++;
     }
+
+    if (tokens->count == 0)
+        return 0;
+
+    if (!command_is_complete(state))
+        return syntax_error(reader, "command is incomplete");
+    if (open_parens != 0)
+        return syntax_error(reader, "unbalanced parentheses");
+
+    return 1;
 }
 
-//check that operators have operands (a valid word on the left and right side)
-void checkIfOperatorsHaveOperands(char* complete_command) {
-    
-    int pos=0;
-    
-    char first_character = complete_command[0];
-    if ( first_character == '<' || first_character == '>' || first_character == '|' || first_character == '&' || first_character == ';' || first_character == ')' ) {
-        fprintf(stderr, "Invalid syntax : checkIfOperatorsHaveOperands!");
-        exit(1);
-    }
-    
-    while(complete_command[pos] != '\0') {
-        pos++;
-    }
-    
-    char last_character = complete_command[pos-1];
-    if ( last_character == '<' || last_character == '>' || last_character == '|' || last_character == '&' || last_character == ';' || last_character == '(' ) {
-        fprintf(stderr, "Invalid syntax : checkIfOperatorsHaveOperands!");
-        exit(1);
-    }
-    
+
+//give READER its own token array and (empty) parse stacks
+static void init_reader_buffers(struct command_reader *reader) {
+    reader->tokens.count = 0;
+    reader->tokens.size = 64 * sizeof(struct token);
+    reader->tokens.tokens = checked_malloc(reader->tokens.size);
+    reader->stacks.operands = NULL;
+    reader->stacks.operators = NULL;
+    reader->stacks.capacity = 0;
 }
 
+static void free_reader_buffers(struct command_reader *reader) {
+    free(reader->tokens.tokens);
+    free(reader->stacks.operands);
+    free(reader->stacks.operators);
+}
 
-//check if parantheses are valid in a complete command
-void validParentheses(char *complete_command){
-    int command_counter = 0;
-    int resolved_parantheses = 0;
-    
-    //can't start with closing parantheses
-    if (complete_command[0] == ')'){
-        fprintf(stderr, "Invalid syntax : Starting with closing parantheses!");
+static command_stream_t make_stream_reader(char const *script, size_t script_size, bool words_in_place) {
+    struct command_reader *reader = checked_malloc(sizeof(*reader));
+    reader->input.pos = script;
+    reader->input.end = script + script_size;
+    reader->line = 1;
+    reader->next_tree_number = 1;
+    init_reader_buffers(reader);
+    reader->words_in_place = words_in_place;
+    reader->script_start = script;
+    reader->fd = -1;
+    reader->get_next_byte = NULL;
+    reader->get_next_byte_argument = NULL;
+    reader->at_eof = true;
+    reader->at_blank_line = false;
+    reader->owned_script = NULL;
+    reader->owned_size = 0;
+
+    //nothing is parsed until someone asks for a command
+    command_stream_t theStream = initStream();
+    theStream->reader = reader;
+    return theStream;
+}
+
+//the buffer a streamed script is read into starts this big, and only
+//grows to hold a complete command that does not fit
+enum { STREAM_BUFFER_SIZE = 1 << 16 };
+
+//a stream that reads its script into a buffer of its own as it is parsed
+static command_stream_t make_streamed_reader(void) {
+
+    //the buffer is refilled as the script is parsed, which moves what
+    //is in it, so words are copied into the trees
+    char *buffer = checked_malloc(STREAM_BUFFER_SIZE);
+    buffer[0] = '\0';
+    command_stream_t theStream = make_stream_reader(buffer, 0, false);
+    struct command_reader *reader = theStream->reader;
+    reader->at_eof = false;
+    reader->owned_script = buffer;
+    reader->owned_size = STREAM_BUFFER_SIZE;
+    return theStream;
+}
+
+command_stream_t
+make_command_stream (int (*get_next_byte) (void *),
+                     void *get_next_byte_argument)
+{
+    command_stream_t theStream = make_streamed_reader();
+    theStream->reader->get_next_byte = get_next_byte;
+    theStream->reader->get_next_byte_argument = get_next_byte_argument;
+    return theStream;
+}
+
+command_stream_t
+make_command_stream_from_fd (int fd)
+{
+    command_stream_t theStream = make_streamed_reader();
+    theStream->reader->fd = fd;
+    return theStream;
+}
+
+//read up to SIZE bytes of a streamed script into SCRIPT from READER's
+//file descriptor with one read call, which returns whatever a pipe holds
+//as soon as it holds anything, and return how many were read; 0 means
+//the script has run out.  a failed read is reported, and ends the shell
+static size_t read_script(struct command_reader *reader, char *script, size_t size) {
+
+    ssize_t n;
+    while ((n = read(reader->fd, script, size)) < 0 && errno == EINTR)
+        continue;
+    if (n < 0) {
+        fprintf(stderr, "%d: error reading script: %s\n", reader->line, strerror(errno));
         exit(1);
     }
-    
-    //check that there are equal amounts of opening and closing parantheses
-    while(complete_command[command_counter] != '\0'){
-        if (complete_command[command_counter] == '('){
-            resolved_parantheses++;
-            
-        } else if (complete_command[command_counter] == ')'){
-            
-            //checks if we have more closing braces proceeding opening braces
-            resolved_parantheses--;
-            if (resolved_parantheses<0){
-                fprintf(stderr, "Invalid syntax : Too many closing parantheses!");
-                exit(1);
+    return n;
+}
+
+//whether more of a streamed script can be read at once.  this guesses
+//no when it cannot tell
+static bool more_script_waiting(struct command_reader *reader) {
+    int waiting;
+    return reader->fd >= 0 && !reader->at_eof &&
+        ioctl(reader->fd, FIONREAD, &waiting) == 0 && waiting > 0;
+}
+
+//keep the part of a streamed script not parsed yet, and read more after
+//it.  the buffer doubles when that part already fills half of it, so a
+//command is read again only a few times however long it is
+static void refill_script(struct command_reader *reader) {
+
+    size_t kept = reader->input.end - reader->input.pos;
+    memmove(reader->owned_script, reader->input.pos, kept);
+    if (kept >= reader->owned_size / 2)
+        reader->owned_script = checked_grow_alloc(reader->owned_script, &reader->owned_size);
+
+    //always leave room for the terminating '\0'
+    char *script = reader->owned_script;
+    size_t size = kept;
+    if (reader->fd >= 0) {
+        size_t got = read_script(reader, script + size, reader->owned_size - 1 - size);
+        size += got;
+        reader->at_eof = got == 0;
+    } else {
+        while (size < reader->owned_size - 1) {
+            int c = reader->get_next_byte(reader->get_next_byte_argument);
+            if (c < 0) {
+                reader->at_eof = true;
+                break;
             }
+            script[size++] = c;
         }
-        command_counter++;
     }
-    
-    if (resolved_parantheses != 0){
-        fprintf(stderr, "Invalid syntax : Number of closing parantheses != number of opening parantheses");
-        exit(1);
+    script[size] = '\0';
+
+    reader->input.pos = script;
+    reader->input.end = script + size;
+}
+
+//like tokenize_complete_command, but read more of a streamed script
+//whenever the lexer gets to the end of what has been read before the
+//command has ended: it may go on after that, so it is tokenized again
+//from its start.  while more is waiting to be read, it is read until the
+//command has at least doubled first, so a long command is not tokenized
+//once per read; once the writer pauses, what has come is run at once
+static int tokenize_next_command(struct command_reader *reader) {
+
+    for (;;) {
+        char const *start = reader->input.pos;
+        int line = reader->line;
+        int result = tokenize_complete_command(reader);
+        if (reader->at_eof || reader->at_blank_line || reader->input.pos < reader->input.end)
+            return result;
+
+        reader->input.pos = start;
+        reader->line = line;
+        size_t tokenized = reader->input.end - start;
+        do
+            refill_script(reader);
+        while ((size_t) (reader->input.end - reader->input.pos) < 2 * tokenized &&
+               more_script_waiting(reader));
     }
 }
 
 command_stream_t
-make_command_stream (int (*get_next_byte) (void *),
-                     void *get_next_byte_argument)
+make_command_stream_from_buffer (char const *script, size_t script_size)
 {
-    
-    //current character
-    char curr;
-    int tree_number = 1;
-    char prev_char_stored = '\0';
-    int consecutive_newlines = 0;
-    
-    
-    //buffer size = 1KB
-    int BUFFER_SIZE = 1024;
-    //buffer to read characters into; buffer can hold 1024 chars at once
-    char *buffer = (char *) checked_malloc(BUFFER_SIZE * sizeof(char));
-    
-    //int to count how many chars are in buffer
-    int numChars = 0;
-    
-    //int to count which line we are on
-    //int syntax_line_counter = 0;
-    int invalid_char_line_counter = 1;
-    
-    //if this is true, we are searching for the right operand of an operator
-    bool found_AND_OR_PIPE_SEQUENCE = false; //looking for operand
-    
-    
-    //declare command stream and allocate space
-    //maybe dont need to allocate space because initStream() already does?
-    command_stream_t theStream;    // = (command_stream_t) checked_malloc(sizeof(struct command_stream));
-    
-    //initialize command_stream
-    theStream = initStream();
-    
-    //start reading the chars from the input
-    while ((curr = get_next_byte(get_next_byte_argument)) != EOF ) {
-        
-        if (numChars > 0){
-            //only stores previous meaningful character, i.e. not whitespace
-            if ((buffer[numChars-1] != ' ' && buffer[numChars-1] != '#')){
-                prev_char_stored = buffer[numChars-1];
-            }
-        }
-        
-        if (prev_char_stored == '&' || prev_char_stored == '|' || prev_char_stored == ';'){
-            found_AND_OR_PIPE_SEQUENCE = true;
-        }
-        
-        
-        
-        ////////////////////////////////////////////////////////////
-        //////////////////      NEWLINE CHAR    ////////////////////
-        ////////////////////////////////////////////////////////////
-        
-        /*
-         New variables introduced:
-         char prev_char_stored;
-         int consecutive_newlines;
-         bool command_has_ended; //haven't needed to use yet
-         
-         */
-        if (identify_char_type(curr) == NEWLINE_CHAR || identify_char_type(curr) == HASHTAG_CHAR){
-            
-            //found a newline, increment counter
-            consecutive_newlines++;
-            
-            //hit second (or more) newline
-            if (consecutive_newlines > 1){
-                //not looking for an operator and
-                if (!found_AND_OR_PIPE_SEQUENCE){
-                    if (identify_char_type(curr) == NEWLINE_CHAR) {
-                        //add second newline to buffer
-                        buffer[numChars] = '\n';
-                        numChars++;
-                        curr = get_next_byte(get_next_byte_argument);
-                    }
-                    /*
-                     check for newlines, whitespaces, and hashtags after second newline
-                     Store newlines on the buffer, ignore white spaces, and for hashtags:
-                     put hashtag and newline on the buffer
-                     */
-                    while (identify_char_type(curr) == NEWLINE_CHAR || identify_char_type(curr) == WHITESPACE_CHAR || identify_char_type(curr) == HASHTAG_CHAR){
-                        if (curr == '\n'){
-                            buffer[numChars] = '\n';
-                            numChars++;
-                        } else if (curr == '#'){
-                            //add hashtag to buffer
-                            consecutive_newlines++;
-                            buffer[numChars] = '#';
-                            numChars++;
-                            
-                            //go to end of comment
-                            while (identify_char_type(curr) != NEWLINE_CHAR){
-                                if ((curr = get_next_byte(get_next_byte_argument)) == EOF) {
-                                    break;
-                                }
-                            }
-                            //broke out of loop, curr is now a newline char; add to buffer
-                            buffer[numChars] = '\n';
-                            numChars++;
-                            
-                        }
-                        
-                        if ((curr = get_next_byte(get_next_byte_argument)) == EOF) {
-                            break;
-                        }
-                    }
-                    
-                    consecutive_newlines = 0;
-                    
-                    //create temporary array with size of numChars;
-                    char* buffer_no_whitespaces = checked_malloc(BUFFER_SIZE * (sizeof(char)));  //the correct syntaxed command
-                    memset(buffer_no_whitespaces, '\0', BUFFER_SIZE * sizeof(char));
-                    
-                    //run validation, then parse if correct
-                    
-                    eatWhiteSpaces(buffer, numChars, buffer_no_whitespaces);
-                    
-                    
-                    int pos = 0;
-                    
-                    while (buffer_no_whitespaces[pos] != '\0'){
-                        if (identify_char_type(buffer_no_whitespaces[pos]) == NEWLINE_CHAR){
-                            invalid_char_line_counter++;
-                        }
-                        if (identify_char_type(buffer_no_whitespaces[pos]) == INVALID_CHAR){
-                            identify_char_type(buffer_no_whitespaces[pos]);
-                            fprintf(stderr, "%d: Invalid character: %c <---", invalid_char_line_counter, buffer_no_whitespaces[pos]);
-                            exit(1);
-                        }
-                        pos++;
-                    }
-                    
-                    checkAndSyntax(buffer_no_whitespaces);
-                    checkForConsecutiveTokens(buffer_no_whitespaces);
-                    checkIfOperatorsHaveOperands(buffer_no_whitespaces);
-                    validParentheses(buffer_no_whitespaces);
-                    
-                    /*
-                     int i;
-                     for (i= 0; i<numChars; i++){
-                     printf("%c", buffer_no_whitespaces[i]);
-                     }
-                     
-                     //this just separates commands
-                     printf("\n");
-                     */
-                    
-                    commandNode_t root = createNodeFromCommand(make_command_tree(buffer_no_whitespaces));
-                    
-                    //printf("adding command node to stream: %s\n", root->cmd->u.word[0]);
-                    
-                    write_list_t write_list = init_write_list();
-                    
-                    //printf("adding command node to stream: %s\n", root->cmd->u.word[0]);
-                    root->write_list = make_write_list(write_list, root->cmd);
-                    read_list_t read_list = init_read_list();
-                    root->read_list = make_read_list(read_list, root->cmd);
-                    
-                    root->tree_number=tree_number;
-                    
-                    root->dependency_list = (commandNode_t*)(checked_realloc(root->dependency_list, (tree_number) * sizeof(commandNode_t)));
-                    memset (root -> dependency_list, '\0', (tree_number) * sizeof(commandNode_t));
-                    
-                    
-                    //printf("adding command node to stream: %s\n", root->cmd->u.word[0]);
-                    
-                    addNodeToStream(theStream, root);
-                    
-                    
-                    //reset everything with memset
-                    memset(buffer, '\0', BUFFER_SIZE * sizeof(char));
-                    free(buffer_no_whitespaces);
-                    numChars = 0;
-                    consecutive_newlines = 0;
-                    
-                    tree_number++;
-                    
-                    
-                    if (curr == EOF)
-                        break;
-                    /*
-                     We are now at a new command.
-                     Add first character to buffer, whether valid or invalid.
-                     Will check syntax later.
-                     */
-                    if (identify_char_type(curr) != HASHTAG_CHAR){
-                        buffer[numChars] = curr;
-                        numChars++;
-                    } else {
-                        //add a hashtag and newline to the buffer
-                        buffer[numChars] = '#';
-                        numChars++;
-                        
-                        //get to the end of the line
-                        while (identify_char_type(curr) != NEWLINE_CHAR){
-                            if ((curr = get_next_byte(get_next_byte_argument)) == EOF) {
-                                break;
-                            }
-                        }
-                        
-                        //now we have a newline; add newline to buffer
-                        buffer[numChars]=curr;
-                        numChars++;
-                        consecutive_newlines++;
-                    }
-                    continue;
-                } else { //if we are looking for operand, don't end the commmand
-                    
-                    while (identify_char_type(curr) == NEWLINE_CHAR || identify_char_type(curr) == WHITESPACE_CHAR || identify_char_type(curr) == HASHTAG_CHAR){
-                        if (curr == '\n'){
-                            buffer[numChars] = '\n';
-                            numChars++;
-                        } else if (curr == '#'){
-                            //add hashtag to buffer
-                            buffer[numChars] = '#';
-                            numChars++;
-                            
-                            while (identify_char_type(curr) != NEWLINE_CHAR){
-                                if ((curr = get_next_byte(get_next_byte_argument)) == EOF) {
-                                    break;
-                                }
-                            }
-                            //broke out of loop, curr is now a newline char; add to buffer
-                            buffer[numChars] = '\n';
-                            numChars++;
-                        }
-                        
-                        if ((curr = get_next_byte(get_next_byte_argument)) == EOF) {
-                            break;
-                        }
-                        
-                        
-                    }
-                    //broken out of while loop, we now have a regular character; add to buffer
-                    
-                    if (curr == EOF)
-                        break;
-                    
-                    buffer[numChars] = curr;
-                    numChars++;
-                    found_AND_OR_PIPE_SEQUENCE = false;
-                    consecutive_newlines = 0;
-                    continue;
-                }
-            } else {
-                //add newline to buffer; this is when number of newlines equals one
-                if (identify_char_type(curr) == HASHTAG_CHAR) {
-                    buffer[numChars] = '#';
-                    numChars++;
-                    
-                    while (identify_char_type(curr) != NEWLINE_CHAR){
-                        if ((curr = get_next_byte(get_next_byte_argument)) == EOF) {
-                            break;
-                        }
-                    }
-                    
-                }
-                buffer[numChars] = '\n';
-                numChars++;
-                continue;
-            }
-        } //end newline case
-        else {
-            
-            
-            if (!found_AND_OR_PIPE_SEQUENCE && consecutive_newlines == 1) {
-                buffer[numChars] = ';';
-                numChars++;
-            }
-            
-            buffer[numChars] = curr;
-            numChars++;
-            consecutive_newlines = 0;
-            
-            //if we are here we no longer skip lines
-            found_AND_OR_PIPE_SEQUENCE = false;
-        }
+    return make_stream_reader(script, script_size, false);
+}
+
+command_stream_t
+make_command_stream_in_place (char *script, size_t script_size)
+{
+    return make_stream_reader(script, script_size, true);
+}
+
+//parse the next complete command into a new tree,
+//or return NULL at the end of the script
+static command_t parse_next_tree(command_stream_t s) {
+
+    struct command_reader *reader = s->reader;
+    if (reader == NULL)
+        return NULL;
+
+    int result = tokenize_next_command(reader);
+    if (result < 0)
+        report_syntax_error(reader, 0);
+    if (result == 0) {
+        //end of the script; the reader is no longer needed
+        free_reader_buffers(reader);
+        free(reader->owned_script);
+        free(reader);
+        s->reader = NULL;
+        return NULL;
     }
-    
-    char* buffer_no_whitespaces = checked_malloc(BUFFER_SIZE * (sizeof(char)));  //the correct syntaxed command
-    memset(buffer_no_whitespaces, '\0', BUFFER_SIZE * sizeof(char));
-    
-    //run validation, then parse if correct
-    //void eatWhiteSpaces(char *buffer, int bufferSize, char *newArray)
-    eatWhiteSpaces(buffer, numChars, buffer_no_whitespaces);
-    int pos = 0;
-    
-    while (buffer_no_whitespaces[pos] != '\0'){
-        if (identify_char_type(buffer_no_whitespaces[pos]) == NEWLINE_CHAR){
-            invalid_char_line_counter++;
+
+    command_t tree = make_command_tree(reader->tokens.tokens, reader->tokens.count, reader->words_in_place, &reader->stacks);
+    tree->tree_number = reader->next_tree_number++;
+    return tree;
+}
+
+/////////////////////////SHARED TREES/////////////////////////
+//  a finished stream keeps every tree, and scripts tend to    //
+//  say the same thing many times over, so a tree the same as  //
+//  one already in the stream is stored once and shared        //
+
+struct tree_slot {
+    uint32_t hash;
+    commandNode_t node;     //the node the tree was first added in; NULL if empty
+};
+
+//an open-addressed hash table of the stream's distinct trees.  its size
+//is a power of two and it is kept at most half full
+struct tree_table {
+    struct tree_slot *slots;
+    size_t num_slots;
+    size_t count;
+};
+
+static uint32_t hash_bytes(uint32_t h, void const *data, size_t size) {
+    //FNV-1a
+    unsigned char const *p = data;
+    size_t i;
+    for (i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+//one past the last entry the tree uses in its words
+static uint32_t tree_num_words(command_t c) {
+    uint32_t end = 1;
+    uint32_t n;
+    for (n = 0; n < c->num_nodes; n++) {
+        uint32_t last = c->input[n] > c->output[n] ? c->input[n] : c->output[n];
+        if (c->type[n] == SIMPLE_COMMAND) {
+            uint32_t w = c->child[n][0];
+            while (c->word[w] != NULL)
+                w++;
+            if (w > last)
+                last = w;
         }
-        if (identify_char_type(buffer_no_whitespaces[pos]) == INVALID_CHAR){
-            identify_char_type(buffer_no_whitespaces[pos]);
-            fprintf(stderr, "%d: Invalid character: %c <---", invalid_char_line_counter, buffer_no_whitespaces[pos]);
-            exit(1);
+        if (last >= end)
+            end = last + 1;
+    }
+    return end;
+}
+
+//trees are built from their tokens in order, so two trees made from the
+//same tokens have the same node arrays and the same words at the same indices
+static uint32_t hash_tree(command_t c, uint32_t num_words) {
+    uint32_t n = c->num_nodes;
+    uint32_t h = hash_bytes(2166136261u, c->type, n);
+    h = hash_bytes(h, c->input, n * sizeof(uint32_t));
+    h = hash_bytes(h, c->output, n * sizeof(uint32_t));
+    h = hash_bytes(h, c->child, n * sizeof(uint32_t[2]));
+
+    uint32_t w;
+    for (w = 1; w < num_words; w++) {
+        char const *word = c->word[w] != NULL ? c->word[w] : "";
+        h = hash_bytes(h, word, strlen(word) + 1);
+    }
+    return h;
+}
+
+static bool same_tree(command_t a, command_t b, uint32_t num_words) {
+    uint32_t n = a->num_nodes;
+    if (b->num_nodes != n || b->root != a->root)
+        return false;
+    if (memcmp(a->type, b->type, n) != 0 ||
+        memcmp(a->input, b->input, n * sizeof(uint32_t)) != 0 ||
+        memcmp(a->output, b->output, n * sizeof(uint32_t)) != 0 ||
+        memcmp(a->child, b->child, n * sizeof(uint32_t[2])) != 0)
+        return false;
+
+    //the nulls ending each simple command's words must line up too
+    uint32_t w;
+    for (w = 1; w < num_words; w++) {
+        if (a->word[w] == NULL || b->word[w] == NULL) {
+            if (a->word[w] != b->word[w])
+                return false;
+        } else if (strcmp(a->word[w], b->word[w]) != 0) {
+            return false;
         }
-        pos++;
     }
-    
-    checkAndSyntax(buffer_no_whitespaces);
-    checkForConsecutiveTokens(buffer_no_whitespaces);
-    checkIfOperatorsHaveOperands(buffer_no_whitespaces);
-    validParentheses(buffer_no_whitespaces);
-    
-    /*
-     if (buffer_no_whitespaces[0] != '\0') {
-     int i;
-     for (i= 0; i<numChars; i++){
-     printf("%c", buffer_no_whitespaces[i]);
-     }
-     printf("\n");
-     }*/
-    
-    
-    //make sure buffer_no_whitespace is not empty
-    if (buffer_no_whitespaces[0] != '\0') {
-        commandNode_t root = createNodeFromCommand(make_command_tree(buffer_no_whitespaces));
-        
-        write_list_t write_list = init_write_list();
+    return true;
+}
+
+static void grow_tree_table(struct tree_table *table) {
+    size_t num_slots = table->num_slots ? 2 * table->num_slots : 1024;
+    struct tree_slot *slots = checked_malloc(num_slots * sizeof(*slots));
+    memset(slots, 0, num_slots * sizeof(*slots));
+
+    size_t i;
+    for (i = 0; i < table->num_slots; i++) {
+        struct tree_slot const *old = &table->slots[i];
+        if (old->node == NULL)
+            continue;
+        size_t j = old->hash & (num_slots - 1);
+        while (slots[j].node != NULL)
+            j = (j + 1) & (num_slots - 1);
+        slots[j] = *old;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->num_slots = num_slots;
+}
+
+//add a parsed tree to the stream, with the lists time travel needs.  if
+//the stream already has the same tree, this one is freed, and its node
+//shares the stream's copy and lists instead
+static void add_tree_to_stream(command_stream_t s, command_t tree, struct tree_table *table) {
+
+    if (2 * (table->count + 1) > table->num_slots)
+        grow_tree_table(table);
+
+    uint32_t num_words = tree_num_words(tree);
+    uint32_t hash = hash_tree(tree, num_words);
+    size_t mask = table->num_slots - 1;
+    size_t i = hash & mask;
+    while (table->slots[i].node != NULL &&
+           !(table->slots[i].hash == hash && same_tree(table->slots[i].node->cmd, tree, num_words)))
+        i = (i + 1) & mask;
+    struct tree_slot *slot = &table->slots[i];
+
+    commandNode_t root;
+    if (slot->node != NULL) {
+        commandNode_t first = slot->node;
+        root = createNodeFromCommand(first->cmd);
+        root->tree_number = tree->tree_number;
+        root->write_list = first->write_list;
+        root->read_list = first->read_list;
+        first->cmd->refs++;
+        free_command(tree);
+    } else {
+        root = createNodeFromCommand(tree);
+        root->cmd->arena = arena_create();
+        write_list_t write_list = init_write_list(root->cmd->arena);
         root->write_list = make_write_list(write_list, root->cmd);
-        read_list_t read_list = init_read_list();
+        read_list_t read_list = init_read_list(root->cmd->arena);
         root->read_list = make_read_list(read_list, root->cmd);
-        root->tree_number=tree_number;
-        
-        
-        root->dependency_list = (commandNode_t*)(checked_realloc(root->dependency_list, (tree_number) * sizeof(commandNode_t)));
-        memset (root -> dependency_list, '\0', (tree_number) * sizeof(commandNode_t));
-        
-        //printf("adding command node to stream: %s\n", root->cmd->u.word[0]);
-        
-        addNodeToStream(theStream, root);
+
+        slot->hash = hash;
+        slot->node = root;
+        table->count++;
     }
-    
-    free(buffer);
-    free(buffer_no_whitespaces);
-    
-    theStream->blocked_commands = (commandNode_t*)checked_realloc(theStream->blocked_commands, theStream->num_nodes * sizeof(commandNode_t));
-    memset(theStream->blocked_commands, '\0', theStream->num_nodes * sizeof(commandNode_t));
-    
-    return theStream;
+
+    //no dependencies until make_dependency_lists finds them
+    root->dependency_list = (commandNode_t*)checked_malloc(sizeof(commandNode_t));
+    root->dependency_list[0] = NULL;
+
+    addNodeToStream(s, root);
 }
 
-void free_command(command_t to_be_freed) {
-    
-    enum command_type cmd_type = to_be_freed->type;
-    
-    free(to_be_freed->input);
-    free(to_be_freed->output);
-    
-    if (cmd_type == AND_COMMAND || cmd_type == OR_COMMAND || cmd_type == PIPE_COMMAND || cmd_type == SEQUENCE_COMMAND) {
-        
-        free_command(to_be_freed->u.command[0]);
-        free_command(to_be_freed->u.command[1]);
-        
-        //we're outta there, now free yourself
-        free(to_be_freed->u.command[0]);
-        free(to_be_freed->u.command[1]);
-        
+//////////////////////PARALLEL PARSING/////////////////////
+// a big script is cut at the blank lines between trees, //
+// and a pool of threads parses the pieces               //
+
+//scripts smaller than this are parsed by one thread
+enum { PARALLEL_PARSE_MIN_SIZE = 1 << 20 };
+//no piece is made smaller than this
+enum { PARSE_CHUNK_MIN_SIZE = 1 << 18 };
+enum { MAX_PARSE_THREADS = 64 };
+
+struct parse_chunk {
+    //a reader over just this piece; its line numbers start again at 1
+    struct command_reader reader;
+
+    //trees parsed from the piece, in order
+    command_t *trees;
+    size_t num_trees;
+    size_t size;            //bytes allocated for trees
+
+    //-1 if the piece has a syntax error
+    int result;
+};
+
+struct parse_job {
+    struct parse_chunk *chunks;
+    int num_chunks;
+    int next_chunk;         //next piece to hand out, taken atomically
+};
+
+/*
+ Find the first tree boundary after the line containing POS: the end of a
+ blank (or comment-only) line that follows a line ending in a complete
+ command.  This is where tokenize_complete_command would stop, so pieces
+ cut there parse exactly as the whole script would.  Return END if there
+ is no such place.
+ */
+static char const *next_tree_boundary(char const *pos, char const *end) {
+
+    char const *line = memchr(pos, '\n', end - pos);
+    if (line == NULL)
+        return end;
+    line++;
+
+    //whether the last line with something on it ended a command; unknown
+    //until we see such a line
+    bool known = false;
+    bool complete = false;
+
+    while (line < end) {
+        char const *line_end = memchr(line, '\n', end - line);
+        if (line_end == NULL)
+            return end;
+
+        //'#' always starts a comment, so what matters is what comes before it
+        char const *content_end = memchr(line, '#', line_end - line);
+        if (content_end == NULL)
+            content_end = line_end;
+        while (content_end > line && content_end[-1] == ' ')
+            content_end--;
+
+        if (content_end > line) {
+            known = true;
+            complete = identify_char_type(content_end[-1]) == REGULAR_CHAR || content_end[-1] == ')' ||
+                       (content_end[-1] == '&' && (content_end - 1 == line || content_end[-2] != '&'));
+        } else if (known && complete) {
+            return line_end + 1;
+        }
+
+        line = line_end + 1;
     }
-    
-    else if (cmd_type == SIMPLE_COMMAND) {
-        
-        char **w = to_be_freed->u.word;
-        while ( *++w) {
-            free(*w);
+
+    return end;
+}
+
+static void *parse_worker(void *arg) {
+
+    struct parse_job *job = arg;
+    int i;
+
+    while ((i = __atomic_fetch_add(&job->next_chunk, 1, __ATOMIC_RELAXED)) < job->num_chunks) {
+
+        struct parse_chunk *chunk = &job->chunks[i];
+        struct command_reader *reader = &chunk->reader;
+
+        while ((chunk->result = tokenize_complete_command(reader)) > 0) {
+            if ((chunk->num_trees + 1) * sizeof(command_t) > chunk->size)
+                chunk->trees = checked_grow_alloc(chunk->trees, &chunk->size);
+            chunk->trees[chunk->num_trees++] = make_command_tree(reader->tokens.tokens, reader->tokens.count, reader->words_in_place, &reader->stacks);
         }
-        //free(w);
+
+        free_reader_buffers(reader);
     }
-    
-    else //(cmd_type == SUBSHELL_COMMAND)
-    {
-        
-        free_command(to_be_freed->u.subshell_command);
-        free(to_be_freed->u.subshell_command);
-        
+
+    return NULL;
+}
+
+//parse the rest of a big script with several threads, adding the trees to
+//the stream in order; leave smaller scripts to the caller
+static void parse_rest_in_parallel(command_stream_t s, struct tree_table *table) {
+
+    struct command_reader *reader = s->reader;
+    char const *pos = reader->input.pos;
+    char const *end = reader->input.end;
+    size_t size = end - pos;
+
+    //a streamed script is not all there to be cut up
+    if (reader->owned_script != NULL)
+        return;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (size < PARALLEL_PARSE_MIN_SIZE || cpus < 2)
+        return;
+
+    int num_threads = cpus < MAX_PARSE_THREADS ? cpus : MAX_PARSE_THREADS;
+
+    //a few pieces per thread, so one slow piece does not hold up the rest
+    size_t max_chunks = size / PARSE_CHUNK_MIN_SIZE;
+    if (max_chunks > (size_t) 4 * num_threads)
+        max_chunks = 4 * num_threads;
+    size_t chunk_size = size / max_chunks;
+
+    //every piece but the last is at least chunk_size long
+    struct parse_chunk *chunks = checked_malloc((max_chunks + 1) * sizeof(*chunks));
+    int num_chunks = 0;
+
+    while (pos < end) {
+        char const *chunk_end = end;
+        if ((size_t) (end - pos) > chunk_size)
+            chunk_end = next_tree_boundary(pos + chunk_size, end);
+
+        struct parse_chunk *chunk = &chunks[num_chunks++];
+        chunk->reader = *reader;
+        chunk->reader.input.pos = pos;
+        chunk->reader.input.end = chunk_end;
+        chunk->reader.line = 1;
+        init_reader_buffers(&chunk->reader);
+        chunk->reader.owned_script = NULL;
+        chunk->num_trees = 0;
+        chunk->size = 64 * sizeof(command_t);
+        chunk->trees = checked_malloc(chunk->size);
+        chunk->result = 0;
+
+        pos = chunk_end;
+    }
+
+    if (num_threads > num_chunks)
+        num_threads = num_chunks;
+
+    //this thread works too; if a thread cannot be created, the others
+    //just take more of the pieces
+    struct parse_job job = { chunks, num_chunks, 0 };
+    pthread_t threads[MAX_PARSE_THREADS];
+    int num_started = 0;
+    while (num_started < num_threads - 1 &&
+           pthread_create(&threads[num_started], NULL, parse_worker, &job) == 0)
+        num_started++;
+    parse_worker(&job);
+    int i;
+    for (i = 0; i < num_started; i++)
+        pthread_join(threads[i], NULL);
+
+    //stitch the trees together in order, numbering them as a serial parse
+    //would, and report the first syntax error in the script
+    int line_offset = reader->line - 1;
+    for (i = 0; i < num_chunks; i++) {
+
+        struct parse_chunk *chunk = &chunks[i];
+        if (chunk->result < 0)
+            report_syntax_error(&chunk->reader, line_offset);
+
+        size_t t;
+        for (t = 0; t < chunk->num_trees; t++) {
+            chunk->trees[t]->tree_number = reader->next_tree_number++;
+            add_tree_to_stream(s, chunk->trees[t], table);
+        }
+        free(chunk->trees);
+
+        line_offset += chunk->reader.line - 1;
+    }
+
+    reader->input.pos = end;
+    reader->line = line_offset + 1;
+    free(chunks);
+}
+
+void
+finish_command_stream (command_stream_t s)
+{
+    command_t tree;
+    struct tree_table table = { NULL, 0, 0 };
+
+    if (s->reader != NULL)
+        parse_rest_in_parallel(s, &table);
+
+    //whatever is left (all of a small script) is parsed here
+    while ((tree = parse_next_tree(s)) != NULL)
+        add_tree_to_stream(s, tree, &table);
+    free(table.slots);
+
+    s->blocked_commands = (commandNode_t*)checked_realloc(s->blocked_commands, s->num_nodes * sizeof(commandNode_t));
+    memset(s->blocked_commands, '\0', s->num_nodes * sizeof(commandNode_t));
+}
+
+//after a syntax error, skip the rest of the complete command it was in:
+//everything up to the next line with nothing on it but spaces or a comment
+static void skip_to_next_command(struct command_reader *reader) {
+
+    struct byte_cursor *input = &reader->input;
+
+    while (input->pos < input->end) {
+        char const *newline = memchr(input->pos, '\n', input->end - input->pos);
+        if (newline == NULL) {
+            input->pos = input->end;
+            return;
+        }
+        input->pos = newline + 1;
+        reader->line++;
+
+        char const *p = skip_spaces(input->pos, input->end);
+        if (p == input->end || *p == '\n' || *p == '#')
+            return;
     }
 }
 
+int check_command_syntax(char const *script_name, char const *script, size_t script_size) {
+
+    //a reader with nowhere to put tokens, so nothing is allocated
+    struct command_reader reader;
+    reader.input.pos = script;
+    reader.input.end = script + script_size;
+    reader.line = 1;
+    reader.tokens.tokens = NULL;
+    reader.tokens.count = 0;
+    reader.tokens.size = 0;
+
+    int errors = 0;
+    int result;
+    while ((result = tokenize_complete_command(&reader)) != 0) {
+        if (result < 0) {
+            fprintf(stderr, "%s:%d: %s\n", script_name, reader.error_line, reader.error_message);
+            errors++;
+            skip_to_next_command(&reader);
+        }
+    }
+    return errors;
+}
+
+size_t command_stream_position(command_stream_t s) {
+    if (s->reader == NULL || s->reader->owned_script != NULL)
+        return 0;
+    return s->reader->input.pos - s->reader->script_start;
+}
+
+//release a whole tree, and its read and write lists if it has them,
+//once nothing else holds it
+void free_command(command_t to_be_freed) {
+    
+    if (--to_be_freed->refs > 0)
+        return;
+    if (to_be_freed->arena != NULL)
+        arena_destroy(to_be_freed->arena);
+    free(to_be_freed);
+}
+
 command_t
 read_command_stream (command_stream_t s)
 {
-    if (s->head == NULL) {
-        return NULL;
-    }
+    //nothing parsed ahead of time; parse the next tree now
+    if (s->head == NULL)
+        return parse_next_tree(s);
     
     command_t grabbed_command = s->head->cmd;
     commandNode_t to_be_freed = s->head;
@@ -0,0 +1,139 @@
+// UCLA CS 111 Lab 1 script loading
+
+#include "script-buffer.h"
+#include "alloc.h"
+
+#include <error.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Initial size of the buffer used when the script cannot be mmap'd.
+enum { READ_CHUNK_SIZE = 1 << 16 };
+
+// release_script_prefix gives back at least this much at a time.
+enum { RELEASE_SIZE = 1 << 20 };
+
+static int
+map_script (int fd, size_t size, struct script_buffer *buf)
+{
+    size_t page = sysconf (_SC_PAGESIZE);
+    size_t map_size = (size / page + 1) * page;
+
+    // Reserve a zero-filled region at least one byte longer than the
+    // file, then map the file over the front of it.  The byte after the
+    // script is then always a readable '\0', even when the file size is
+    // a multiple of the page size.
+    char *region = mmap (NULL, map_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+        return 0;
+    if (mmap (region, size, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_FIXED, fd, 0)
+        == MAP_FAILED)
+    {
+        munmap (region, map_size);
+        return 0;
+    }
+    madvise (region, size, MADV_SEQUENTIAL);
+
+    buf->data = region;
+    buf->size = size;
+    buf->map_size = map_size;
+    buf->released = 0;
+    return 1;
+}
+
+static void
+read_script (int fd, char const *file_name, struct script_buffer *buf)
+{
+    size_t alloc = READ_CHUNK_SIZE;
+    size_t size = 0;
+    char *data = checked_malloc (alloc);
+
+    for (;;)
+    {
+        // Always leave room for the terminating '\0'.
+        if (alloc - size < 2)
+            data = checked_grow_alloc (data, &alloc);
+
+        ssize_t n = read (fd, data + size, alloc - size - 1);
+        if (n == 0)
+            break;
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            error (1, errno, "%s: read error", file_name);
+        }
+        size += n;
+    }
+
+    data[size] = '\0';
+    buf->data = data;
+    buf->size = size;
+    buf->map_size = 0;
+    buf->released = 0;
+}
+
+void
+load_script (struct script_buffer *buf, char const *file_name)
+{
+    int from_stdin = strcmp (file_name, "-") == 0;
+    int fd = from_stdin ? 0 : open (file_name, O_RDONLY);
+    if (fd < 0)
+        error (1, errno, "%s: cannot open", file_name);
+
+    struct stat st;
+    if (fstat (fd, &st) != 0)
+        error (1, errno, "%s: cannot stat", file_name);
+
+    if (! (S_ISREG (st.st_mode) && 0 < st.st_size
+           && map_script (fd, st.st_size, buf)))
+        read_script (fd, file_name, buf);
+
+    buf->owner = st.st_uid;
+    if (S_ISREG (st.st_mode))
+        buf->mtime = st.st_mtim;
+    else
+        buf->mtime.tv_sec = buf->mtime.tv_nsec = 0;
+
+    if (! from_stdin)
+        close (fd);
+}
+
+void
+release_script_prefix (struct script_buffer *buf, size_t offset)
+{
+    if (! buf->map_size)
+        return;
+
+    // The mapping starts on a page boundary, so the pages wholly before
+    // OFFSET are the first OFFSET / PAGE of them.  Private pages the
+    // parser wrote to are dropped; the file's own pages are unmapped and
+    // would be read again if touched.
+    size_t page = sysconf (_SC_PAGESIZE);
+    size_t end = offset / page * page;
+    if (end - buf->released < RELEASE_SIZE)
+        return;
+    madvise (buf->data + buf->released, end - buf->released, MADV_DONTNEED);
+    buf->released = end;
+}
+
+void
+release_script (struct script_buffer *buf)
+{
+    if (buf->map_size)
+        munmap (buf->data, buf->map_size);
+    else
+        free (buf->data);
+    buf->data = NULL;
+    buf->size = 0;
+    buf->map_size = 0;
+    buf->released = 0;
+    buf->mtime.tv_sec = buf->mtime.tv_nsec = 0;
+}
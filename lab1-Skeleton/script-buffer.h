@@ -0,0 +1,42 @@
+// UCLA CS 111 Lab 1 script loading
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+
+/* An in-memory copy of a script.  DATA holds SIZE bytes followed by a
+ '\0', so the lexer can scan it in place without bounds checks on the
+ byte after the last one.  DATA is private and writable (mapped files are
+ copy-on-write), so the parser may end words in place.  */
+struct script_buffer
+{
+    char *data;
+    size_t size;
+
+    // Length of the mapping backing DATA, or 0 if DATA was malloc'd.
+    size_t map_size;
+
+    // How many bytes at the start of the mapping have been given back by
+    // release_script_prefix.
+    size_t released;
+
+    // When the script file was last modified, or zero if it is not a
+    // regular file.
+    struct timespec mtime;
+
+    // Who owns the script file, if it is a regular file.
+    uid_t owner;
+};
+
+/* Load FILE_NAME into BUF, or standard input if FILE_NAME is "-".
+ Regular files are mmap'd; pipes and terminals are read in large
+ chunks.  Report an error and exit on failure.  */
+void load_script (struct script_buffer *buf, char const *file_name);
+
+/* Give back the memory holding the first OFFSET bytes of BUF, which
+ the caller will not look at again.  Only whole pages of a mapped script
+ are given back, and only a megabyte or more at a time, so calling this
+ after every command is cheap.  */
+void release_script_prefix (struct script_buffer *buf, size_t offset);
+
+/* Release the memory held by BUF.  */
+void release_script (struct script_buffer *buf);
@@ -0,0 +1,628 @@
+// UCLA CS 111 Lab 1 cache of parsed scripts
+
+#include "command-internals.h"
+#include "command.h"
+#include "alloc.h"
+#include "intern.h"
+#include "script-buffer.h"
+#include "script-cache.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* A cache file holds a header and then these arrays, in order: trees,
+ commands, words, files, dependencies, and the text of every string.
+ Strings are byte offsets into the text, where offset 0 is an empty
+ string that stands for "none".  A command's children come before it,
+ so each tree's commands are a run ending at its root.  The file is in
+ the machine's own byte order and layout; it is only a cache.  */
+
+#define CACHE_SUFFIX ".ttcache"
+
+// Change this whenever the layout below changes.
+static char const cache_magic[8] = "TTCACHE1";
+
+struct cache_header
+{
+    char magic[8];
+    uint64_t script_size;
+    int64_t script_mtime_sec;
+    int64_t script_mtime_nsec;
+    uint64_t script_hash;
+    uint32_t num_trees;
+    uint32_t num_commands;
+    uint32_t num_words;
+    uint32_t num_files;
+    uint32_t num_deps;
+    uint32_t text_size;
+};
+
+struct cache_tree
+{
+    uint32_t root;
+
+    // FILES[FIRST_FILE] onward: NUM_READS files read, then NUM_WRITES
+    // files written.
+    uint32_t first_file;
+    uint32_t num_reads;
+    uint32_t num_writes;
+
+    // DEPS[FIRST_DEP] onward: indices of earlier trees this one waits for.
+    uint32_t first_dep;
+    uint32_t num_deps;
+};
+
+struct cache_command
+{
+    uint32_t type;
+    uint32_t input;
+    uint32_t output;
+
+    // The children of an operator, the body of a subshell (B unused), or
+    // the first word and number of words of a simple command.
+    uint32_t a;
+    uint32_t b;
+};
+
+// Where each array is in a mapped cache file.
+struct cache_layout
+{
+    struct cache_header const *header;
+    struct cache_tree const *trees;
+    struct cache_command const *commands;
+    uint32_t const *words;
+    uint32_t const *files;
+    uint32_t const *deps;
+    char const *text;
+};
+
+static uint64_t
+hash_script (char const *data, size_t size)
+{
+    // FNV-1a, with 0 kept to mean "not computed".
+    uint64_t h = 14695981039346656037u;
+    size_t i;
+    for (i = 0; i < size; i++)
+    {
+        h ^= (unsigned char) data[i];
+        h *= 1099511628211u;
+    }
+    return h ? h : 1;
+}
+
+/* Reading a cache.  */
+
+static int
+find_sections (struct cache_layout *l, char const *map, size_t size)
+{
+    if (size < sizeof *l->header)
+        return 0;
+    struct cache_header const *h = (struct cache_header const *) map;
+
+    // The counts are 32 bits, so none of these sums can overflow.
+    uint64_t trees = sizeof *h;
+    uint64_t commands = trees + (uint64_t) h->num_trees * sizeof *l->trees;
+    uint64_t words = commands
+                     + (uint64_t) h->num_commands * sizeof *l->commands;
+    uint64_t files = words + (uint64_t) h->num_words * sizeof *l->words;
+    uint64_t deps = files + (uint64_t) h->num_files * sizeof *l->files;
+    uint64_t text = deps + (uint64_t) h->num_deps * sizeof *l->deps;
+    if (text + h->text_size != size)
+        return 0;
+
+    l->header = h;
+    l->trees = (struct cache_tree const *) (map + trees);
+    l->commands = (struct cache_command const *) (map + commands);
+    l->words = (uint32_t const *) (map + words);
+    l->files = (uint32_t const *) (map + files);
+    l->deps = (uint32_t const *) (map + deps);
+    l->text = map + text;
+    return 1;
+}
+
+static int
+cache_matches (struct cache_layout const *l, struct script_cache *cache,
+               struct script_buffer const *script)
+{
+    struct cache_header const *h = l->header;
+    if (memcmp (h->magic, cache_magic, sizeof cache_magic) != 0
+        || h->script_size != cache->script_size)
+        return 0;
+    if (h->script_mtime_sec == cache->script_mtime.tv_sec
+        && h->script_mtime_nsec == cache->script_mtime.tv_nsec)
+        return 1;
+
+    // The script was touched, but it may not have changed.
+    if (! cache->script_hash)
+        cache->script_hash = hash_script (script->data, script->size);
+    return h->script_hash == cache->script_hash;
+}
+
+static int
+strings_are_sound (uint32_t const *strings, uint32_t n, uint32_t text_size)
+{
+    uint32_t i;
+    for (i = 0; i < n; i++)
+        if (strings[i] == 0 || text_size <= strings[i])
+            return 0;
+    return 1;
+}
+
+/* Check that every index in the cache is in range and that every tree
+ is well formed, so that a damaged file is ignored rather than run.  */
+static int
+cache_is_sound (struct cache_layout const *l)
+{
+    struct cache_header const *h = l->header;
+    if (h->text_size == 0 || l->text[h->text_size - 1] != '\0'
+        || ! strings_are_sound (l->words, h->num_words, h->text_size)
+        || ! strings_are_sound (l->files, h->num_files, h->text_size))
+        return 0;
+
+    uint32_t first = 0;
+    uint32_t t;
+    for (t = 0; t < h->num_trees; t++)
+    {
+        struct cache_tree const *tree = &l->trees[t];
+        if (tree->root < first || h->num_commands <= tree->root)
+            return 0;
+
+        // The tree's own word array must fit 32-bit indices too.
+        uint64_t num_words = 1;
+        uint32_t i;
+        for (i = first; i <= tree->root; i++)
+        {
+            struct cache_command const *c = &l->commands[i];
+            if (h->text_size <= c->input || h->text_size <= c->output)
+                return 0;
+            num_words += (c->input != 0) + (c->output != 0);
+            if (c->type == SIMPLE_COMMAND)
+                num_words += (uint64_t) c->b + 1;
+            switch (c->type)
+            {
+            case AND_COMMAND:
+            case SEQUENCE_COMMAND:
+            case OR_COMMAND:
+            case PIPE_COMMAND:
+                if (c->a < first || i <= c->a || c->b < first || i <= c->b)
+                    return 0;
+                break;
+            case SUBSHELL_COMMAND:
+            case BACKGROUND_COMMAND:
+                if (c->a < first || i <= c->a)
+                    return 0;
+                break;
+            case SIMPLE_COMMAND:
+                if (c->b == 0 || h->num_words < c->a
+                    || h->num_words - c->a < c->b)
+                    return 0;
+                break;
+            default:
+                return 0;
+            }
+        }
+        if (UINT32_MAX < num_words)
+            return 0;
+        first = tree->root + 1;
+
+        if (h->num_files < tree->first_file
+            || h->num_files - tree->first_file < tree->num_reads
+            || (h->num_files - tree->first_file - tree->num_reads
+                < tree->num_writes))
+            return 0;
+
+        if (h->num_deps < tree->first_dep
+            || h->num_deps - tree->first_dep < tree->num_deps)
+            return 0;
+        for (i = 0; i < tree->num_deps; i++)
+            if (t <= l->deps[tree->first_dep + i])
+                return 0;
+    }
+
+    return first == h->num_commands;
+}
+
+static char *
+cache_string (struct cache_layout const *l, uint32_t offset)
+{
+    // The mapping is read-only; nothing writes through these pointers.
+    return offset ? (char *) l->text + offset : 0;
+}
+
+/* Build the tree made of commands FIRST through ROOT, renumbering its
+ nodes from 0 and giving it its own word array.  */
+static command_t
+build_tree (struct cache_layout const *l, uint32_t first, uint32_t root)
+{
+    uint32_t num_words = 1;
+    uint32_t i;
+    for (i = first; i <= root; i++)
+    {
+        struct cache_command const *c = &l->commands[i];
+        num_words += (c->input != 0) + (c->output != 0);
+        if (c->type == SIMPLE_COMMAND)
+            num_words += c->b + 1;
+    }
+
+    char *text;
+    command_t tree = alloc_command_tree (root - first + 1, num_words, 0, &text);
+    uint32_t next_word = 1;
+    for (i = first; i <= root; i++)
+    {
+        struct cache_command const *c = &l->commands[i];
+        uint32_t n = i - first;
+        tree->type[n] = c->type;
+        tree->input[n] = 0;
+        tree->output[n] = 0;
+        if (c->input)
+        {
+            tree->word[next_word] = cache_string (l, c->input);
+            tree->input[n] = next_word++;
+        }
+        if (c->output)
+        {
+            tree->word[next_word] = cache_string (l, c->output);
+            tree->output[n] = next_word++;
+        }
+
+        switch (c->type)
+        {
+        case SIMPLE_COMMAND:
+        {
+            uint32_t j;
+            tree->child[n][0] = next_word;
+            tree->child[n][1] = 0;
+            for (j = 0; j < c->b; j++)
+                tree->word[next_word++] = cache_string (l, l->words[c->a + j]);
+            tree->word[next_word++] = 0;
+            break;
+        }
+        case SUBSHELL_COMMAND:
+        case BACKGROUND_COMMAND:
+            tree->child[n][0] = c->a - first;
+            tree->child[n][1] = 0;
+            break;
+        default:
+            tree->child[n][0] = c->a - first;
+            tree->child[n][1] = c->b - first;
+            break;
+        }
+    }
+
+    return tree;
+}
+
+static command_stream_t
+build_stream (struct cache_layout const *l)
+{
+    struct cache_header const *h = l->header;
+    command_stream_t stream = initStream ();
+    commandNode_t *nodes = checked_malloc (h->num_trees * sizeof *nodes);
+
+    uint32_t first = 0;
+    uint32_t t;
+    for (t = 0; t < h->num_trees; t++)
+    {
+        struct cache_tree const *tree = &l->trees[t];
+        command_t root = build_tree (l, first, tree->root);
+        struct arena *arena = arena_create ();
+        root->arena = arena;
+        first = tree->root + 1;
+
+        commandNode_t node = createNodeFromCommand (root);
+        node->tree_number = t + 1;
+
+        uint32_t const *file = &l->files[tree->first_file];
+        uint32_t j;
+        node->read_list = init_read_list (arena);
+        for (j = 0; j < tree->num_reads; j++)
+            add_rnode_to_list (create_rnode (arena,
+                                             cache_string (l, *file++)),
+                               node->read_list);
+        node->write_list = init_write_list (arena);
+        for (j = 0; j < tree->num_writes; j++)
+            add_wnode_to_list (create_wnode (arena,
+                                             cache_string (l, *file++)),
+                               node->write_list);
+
+        node->dependency_list =
+          checked_realloc (node->dependency_list,
+                           (tree->num_deps + 1) * sizeof *node->dependency_list);
+        for (j = 0; j < tree->num_deps; j++)
+            node->dependency_list[j] = nodes[l->deps[tree->first_dep + j]];
+        node->dependency_list[tree->num_deps] = 0;
+
+        addNodeToStream (stream, node);
+        nodes[t] = node;
+    }
+
+    stream->blocked_commands =
+      checked_realloc (stream->blocked_commands,
+                       stream->num_nodes * sizeof *stream->blocked_commands);
+    memset (stream->blocked_commands, 0,
+            stream->num_nodes * sizeof *stream->blocked_commands);
+
+    free (nodes);
+    return stream;
+}
+
+/* Whether a cache file with status ST may be used for a script owned by
+ SCRIPT_OWNER.  Anyone could have planted a file in a shared directory
+ such as /tmp, so it must be a regular file that only the user running
+ it or the script's owner can have written.  */
+static int
+cache_file_trusted (struct stat const *st, uid_t script_owner)
+{
+    return S_ISREG (st->st_mode)
+           && (st->st_uid == geteuid () || st->st_uid == script_owner)
+           && ! (st->st_mode & (S_IWGRP | S_IWOTH));
+}
+
+/* Whether the directory holding FILE_NAME belongs to the user, so that
+ a cache written there can be trusted later.  */
+static int
+own_directory (char const *file_name)
+{
+    char const *slash = strrchr (file_name, '/');
+    struct stat st;
+    int ok;
+    if (! slash)
+        ok = stat (".", &st) == 0;
+    else
+    {
+        size_t length = slash == file_name ? 1 : slash - file_name;
+        char *dir = checked_malloc (length + 1);
+        memcpy (dir, file_name, length);
+        dir[length] = '\0';
+        ok = stat (dir, &st) == 0;
+        free (dir);
+    }
+    return ok && S_ISDIR (st.st_mode) && st.st_uid == geteuid ();
+}
+
+command_stream_t
+open_script_cache (struct script_cache *cache, char const *script_name,
+                   struct script_buffer const *script)
+{
+    cache->file_name = 0;
+    cache->script_size = script->size;
+    cache->script_mtime = script->mtime;
+    cache->script_owner = script->owner;
+    cache->script_hash = 0;
+
+    // Only a regular file has a place to keep a cache next to it.
+    if (strcmp (script_name, "-") == 0
+        || (script->mtime.tv_sec == 0 && script->mtime.tv_nsec == 0))
+        return 0;
+
+    cache->file_name = checked_malloc (strlen (script_name)
+                                       + sizeof CACHE_SUFFIX);
+    strcpy (cache->file_name, script_name);
+    strcat (cache->file_name, CACHE_SUFFIX);
+
+    command_stream_t stream = 0;
+    // Check the file that was opened, not whatever the name now names.
+    int fd = open (cache->file_name,
+                   O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+    struct stat st;
+    if (0 <= fd && fstat (fd, &st) == 0
+        && cache_file_trusted (&st, cache->script_owner) && 0 < st.st_size)
+    {
+        // The mapping stays for as long as the trees built from it.
+        char const *map = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            struct cache_layout l;
+            if (find_sections (&l, map, st.st_size)
+                && cache_matches (&l, cache, script)
+                && cache_is_sound (&l))
+                stream = build_stream (&l);
+            else
+                munmap ((void *) map, st.st_size);
+        }
+    }
+    if (0 <= fd)
+        close (fd);
+
+    // A new cache will need the hash of the script as it is now.
+    if (! stream && ! cache->script_hash)
+        cache->script_hash = hash_script (script->data, script->size);
+    return stream;
+}
+
+/* Writing a cache.  */
+
+// An array that grows as things are added to its end.
+struct growing
+{
+    char *data;
+    size_t used;
+    size_t size;
+};
+
+static size_t
+append (struct growing *g, void const *p, size_t n)
+{
+    size_t offset = g->used;
+    if (g->size - g->used < n)
+    {
+        if (! g->size)
+            g->size = 1024;
+        while (g->size - g->used < n)
+            g->size *= 2;
+        g->data = checked_realloc (g->data, g->size);
+    }
+    memcpy (g->data + g->used, p, n);
+    g->used += n;
+    return offset;
+}
+
+struct cache_writer
+{
+    struct growing trees, commands, words, files, deps, text;
+};
+
+static uint32_t
+save_string (struct cache_writer *w, char const *s)
+{
+    if (! s)
+        return 0;
+    return append (&w->text, s, strlen (s) + 1);
+}
+
+static void
+save_file (struct cache_writer *w, int file_id)
+{
+    uint32_t offset = save_string (w, interned_string (file_id));
+    append (&w->files, &offset, sizeof offset);
+}
+
+// Save the nodes of tree C in order, which puts children before their
+// parents as the cache requires, and return the index of its root.
+static uint32_t
+save_commands (struct cache_writer *w, command_t c)
+{
+    uint32_t first = w->commands.used / sizeof (struct cache_command);
+    uint32_t n;
+    for (n = 0; n < c->num_nodes; n++)
+    {
+        struct cache_command cc;
+        cc.type = c->type[n];
+        cc.input = save_string (w, c->word[c->input[n]]);
+        cc.output = save_string (w, c->word[c->output[n]]);
+        cc.a = 0;
+        cc.b = 0;
+
+        switch (c->type[n])
+        {
+        case SIMPLE_COMMAND:
+        {
+            char **word;
+            cc.a = w->words.used / sizeof (uint32_t);
+            for (word = &c->word[c->child[n][0]]; *word; word++)
+            {
+                uint32_t offset = save_string (w, *word);
+                append (&w->words, &offset, sizeof offset);
+                cc.b++;
+            }
+            break;
+        }
+        case SUBSHELL_COMMAND:
+        case BACKGROUND_COMMAND:
+            cc.a = first + c->child[n][0];
+            break;
+        default:
+            cc.a = first + c->child[n][0];
+            cc.b = first + c->child[n][1];
+            break;
+        }
+
+        append (&w->commands, &cc, sizeof cc);
+    }
+
+    return first + c->root;
+}
+
+static void
+save_tree (struct cache_writer *w, commandNode_t node)
+{
+    struct cache_tree tree;
+    tree.root = save_commands (w, node->cmd);
+
+    struct rnode *r;
+    struct wnode *wn;
+    tree.first_file = w->files.used / sizeof (uint32_t);
+    tree.num_reads = 0;
+    for (r = node->read_list ? node->read_list->head : 0; r; r = r->next)
+    {
+        save_file (w, r->file_id);
+        tree.num_reads++;
+    }
+    tree.num_writes = 0;
+    for (wn = node->write_list ? node->write_list->head : 0; wn; wn = wn->next)
+    {
+        save_file (w, wn->file_id);
+        tree.num_writes++;
+    }
+
+    commandNode_t *dep;
+    tree.first_dep = w->deps.used / sizeof (uint32_t);
+    tree.num_deps = 0;
+    for (dep = node->dependency_list; *dep; dep++)
+    {
+        uint32_t index = (*dep)->tree_number - 1;
+        append (&w->deps, &index, sizeof index);
+        tree.num_deps++;
+    }
+
+    append (&w->trees, &tree, sizeof tree);
+}
+
+void
+save_script_cache (struct script_cache const *cache, command_stream_t stream)
+{
+    if (! cache->file_name || ! own_directory (cache->file_name))
+        return;
+
+    struct cache_writer w;
+    memset (&w, 0, sizeof w);
+    append (&w.text, "", 1);
+
+    commandNode_t node;
+    for (node = stream->head; node; node = node->next)
+        save_tree (&w, node);
+
+    struct cache_header h;
+    memset (&h, 0, sizeof h);
+    memcpy (h.magic, cache_magic, sizeof h.magic);
+    h.script_size = cache->script_size;
+    h.script_mtime_sec = cache->script_mtime.tv_sec;
+    h.script_mtime_nsec = cache->script_mtime.tv_nsec;
+    h.script_hash = cache->script_hash;
+    h.num_trees = w.trees.used / sizeof (struct cache_tree);
+    h.num_commands = w.commands.used / sizeof (struct cache_command);
+    h.num_words = w.words.used / sizeof (uint32_t);
+    h.num_files = w.files.used / sizeof (uint32_t);
+    h.num_deps = w.deps.used / sizeof (uint32_t);
+    h.text_size = w.text.used;
+
+    // Write a new file and rename it into place, so that a run reading
+    // the cache never sees half of one.  Offsets are 32 bits, so a
+    // script too big for them goes without.
+    size_t name_size = strlen (cache->file_name) + sizeof ".XXXXXX";
+    char *tmp_name = checked_malloc (name_size);
+    strcpy (tmp_name, cache->file_name);
+    strcat (tmp_name, ".XXXXXX");
+    int fd = w.text.used <= UINT32_MAX ? mkstemp (tmp_name) : -1;
+    if (0 <= fd)
+    {
+        FILE *f = fdopen (fd, "w");
+        int ok = f != 0;
+        struct growing const *arrays[] =
+          { &w.trees, &w.commands, &w.words, &w.files, &w.deps, &w.text };
+        size_t i;
+        ok = ok && fwrite (&h, sizeof h, 1, f) == 1;
+        for (i = 0; ok && i < sizeof arrays / sizeof *arrays; i++)
+            ok = fwrite (arrays[i]->data, 1, arrays[i]->used, f)
+                 == arrays[i]->used;
+        if (f)
+            ok = fclose (f) == 0 && ok;
+        else
+            close (fd);
+        if (! (ok && rename (tmp_name, cache->file_name) == 0))
+            unlink (tmp_name);
+    }
+
+    free (tmp_name);
+    free (w.trees.data);
+    free (w.commands.data);
+    free (w.words.data);
+    free (w.files.data);
+    free (w.deps.data);
+    free (w.text.data);
+}
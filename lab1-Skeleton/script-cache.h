@@ -0,0 +1,44 @@
+// UCLA CS 111 Lab 1 cache of parsed scripts
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+struct script_buffer;
+
+/* What a cache file must record about a script for it to be used.  */
+struct script_cache
+{
+    // Name of the cache file, or 0 if the script cannot have one.
+    char *file_name;
+
+    uint64_t script_size;
+    struct timespec script_mtime;
+
+    // Who owns the script.  Only a cache owned by the user running the
+    // script or by the script's owner, and writable by no one else, is
+    // trusted: its commands are run as they are read from it.
+    uid_t script_owner;
+
+    // Hash of the script's contents, or 0 if not computed yet.
+    uint64_t script_hash;
+};
+
+/* Look for a cache of the script SCRIPT_NAME, whose contents are in
+ SCRIPT, and fill in CACHE for a later save_script_cache.  The cache is
+ the file SCRIPT_NAME.ttcache.  It is used if it is trusted (see
+ struct script_cache) and records the script's size and either its
+ modification time or the hash of its contents.
+ Then return a finished command stream built from it, with read, write
+ and dependency lists filled in, whose words point into the mapped cache
+ file.  Otherwise return 0.  Call this before SCRIPT is parsed in place,
+ since that changes its contents.  */
+command_stream_t open_script_cache (struct script_cache *cache,
+                                    char const *script_name,
+                                    struct script_buffer const *script);
+
+/* Save the trees of STREAM, which must be finished and have its
+ dependency lists made, to the cache described by CACHE.  A cache that
+ cannot be written, or would go in a directory the user does not own, is
+ silently skipped.  */
+void save_script_cache (struct script_cache const *cache,
+                        command_stream_t stream);
@@ -0,0 +1,194 @@
+#! /bin/sh
+
+# UCLA CS 111 Lab 1 - Test that scripts run and do what they say.
+
+tmp=$0-$$.tmp
+mkdir "$tmp" || exit
+
+(
+cd "$tmp" || exit
+
+# Run test.sh with timetrash and ARGS, and compare what it prints with
+# test.exp.  Nothing should go to stderr.
+check () {
+  ../timetrash "$@" test.sh >test.out 2>test.err || {
+    echo >&2 "timetrash $* failed"
+    cat test.err
+    return 1
+  }
+  diff -u test.exp test.out || return
+  test ! -s test.err || {
+    cat test.err
+    return 1
+  }
+}
+
+mkdir bin || exit
+dir=$(pwd -P) || exit
+
+# Builtins run in the shell, with their redirections only while they run.
+# cd in a subshell lasts until the subshell ends, even when exit ends it,
+# and exit leaves only the innermost subshell.  A pipeline carries more
+# than a pipe holds, with every stage running at once.
+cat >test.sh <<'EOT'
+echo -n no- && echo newline
+
+echo to a file >f.out ; echo still on stdout
+
+cat f.out
+
+echo -n x >f.out ; cat f.out ; echo
+
+echo back <f.out
+
+(cd bin) ; pwd
+
+(cd / ; exit 0) ; pwd
+
+(cd bin ; pwd) ; pwd
+
+cd bin ; pwd
+
+cd ..
+
+(echo in ; exit 4 ; echo not run) || echo exit 4 left only the subshell
+
+(exit 3) && echo not run
+
+false || true && echo ok
+
+: ; echo colon
+
+echo bg >bg.out &
+
+wait
+
+cat bg.out
+
+echo piped | tr a-z A-Z
+
+seq 200000 | sort -rn | head -n 1
+
+seq 100000 | (cat ; echo tail) | tail -n 2
+
+seq 300000 >big.out
+
+cat big.out | cat | wc -l
+EOT
+
+cat >test.exp <<EOT
+no-newline
+still on stdout
+to a file
+x
+back
+$dir
+$dir
+$dir/bin
+$dir
+$dir/bin
+in
+exit 4 left only the subshell
+ok
+colon
+bg
+PIPED
+200000
+100000
+tail
+300000
+EOT
+
+check || exit
+TIMETRASH_FORK=1 check || exit
+
+# exit ends the script with its status, running nothing after it.
+cat >test.sh <<'EOT'
+true && exit 7 && echo not run
+
+echo not run either
+EOT
+
+../timetrash test.sh >test.out 2>&1
+status=$?
+test $status -eq 7 && test ! -s test.out || {
+  echo >&2 "exit 7 ended the script with status $status"
+  cat test.out
+  exit 1
+}
+
+# A bare exit returns the status of the command before it, even when
+# that was in an earlier tree.
+printf 'false\n\nexit\n' >test.sh || exit
+../timetrash test.sh >test.out 2>&1
+status=$?
+test $status -eq 1 && test ! -s test.out || {
+  echo >&2 "false, then exit, ended the script with status $status"
+  cat test.out
+  exit 1
+}
+
+# The optimizer keeps whatever a bare exit reads the status of.
+while read -r expected script; do
+  echo "$script" >test.sh || exit
+  ../timetrash test.sh >test.out 2>&1
+  status=$?
+  test $status -eq $expected || {
+    echo >&2 "\"$script\" exited $status, not $expected"
+    exit 1
+  }
+done <<'EOT'
+1 false || exit
+1 false ; exit
+0 ls /nonexistent ; true ; exit
+1 true ; false ; exit
+EOT
+
+# A piped script's trees run as they arrive, without waiting for more.
+(
+  echo 'echo first >first.out'
+  echo
+  sleep 1
+  if test -s first.out; then
+    echo 'echo in time'
+  else
+    echo 'echo too late'
+  fi
+) | ../timetrash - >test.out 2>&1
+echo in time | diff -u - test.out || exit
+
+# A program with no "#!" line is run with /bin/sh, as execvp would.
+printf 'echo no shebang "$@"\n' >bin/noshe && chmod +x bin/noshe || exit
+PATH=$PWD/bin:$PATH
+export PATH
+
+cat >test.sh <<'EOT'
+noshe a b
+
+(noshe c) | cat
+
+noshe d >bg.out &
+
+wait
+
+cat bg.out
+EOT
+
+cat >test.exp <<'EOT'
+no shebang a b
+no shebang c
+no shebang d
+EOT
+
+check || exit
+TIMETRASH_FORK=1 check || exit
+
+# Under time travel each tree is run by a copy of the shell, which
+# becomes the program when the tree is just one.
+echo noshe t >test.sh || exit
+echo no shebang t >test.exp || exit
+check -t || exit
+
+) || exit
+
+rm -fr "$tmp"
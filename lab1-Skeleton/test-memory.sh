@@ -0,0 +1,67 @@
+#! /bin/sh
+
+# UCLA CS 111 Lab 1 - Test that memory stays flat however long the script is.
+
+trees=1000000
+
+tmp=$0-$$.tmp
+mkdir "$tmp" || exit
+(
+cd "$tmp" || exit
+status=
+
+# About 50 MB of script, far more than either run below may use.
+awk -v n="$trees" 'BEGIN {
+  for (i = 0; i < n; i++)
+    printf "echo tree %d <in%d | sort >out%d && rm x\n\n", i, i, i
+}' >test.sh || exit
+
+# Read from a pipe, the script is parsed as it arrives, so it runs in
+# less address space than the script itself would take.
+last=$(cat test.sh | (ulimit -v 32768 && ../timetrash -p -) | tail -n 1)
+test "$last" = "    rm x" || {
+  echo >&2 "piped script did not run to the end in 32 MB"
+  status=1
+}
+
+# Run timetrash with ARGS, watching its resident size until it exits,
+# and print the peak in kB.  Fail if timetrash does.
+watch_peak () {
+  ../timetrash "$@" >/dev/null &
+  pid=$!
+  peak=
+  get_hwm='s/^VmHWM:[[:space:]]*\([0-9]*\) kB/\1/p'
+  while hwm=$(sed -n "$get_hwm" /proc/$pid/status 2>/dev/null) &&
+        test -n "$hwm"; do
+    peak=$hwm
+    sleep 1
+  done
+  wait $pid || return
+  echo "$peak"
+}
+
+if test -r /proc/self/status; then
+  # A mapped script is given back as it is parsed.
+  peak=$(watch_peak -p test.sh) || status=1
+  test -z "$peak" || test "$peak" -lt 16384 || {
+    echo >&2 "mapped script peaked at $peak kB"
+    status=1
+  }
+
+  # Running the trees one after another frees each once it is done.
+  # Builtins start no processes, so this is all the shell's own memory.
+  awk -v n="$trees" 'BEGIN {
+    for (i = 0; i < n; i++)
+      printf "echo tree %d >/dev/null\n\n", i
+  }' >run.sh || exit
+  peak=$(watch_peak run.sh) || status=1
+  test -z "$peak" || test "$peak" -lt 16384 || {
+    echo >&2 "running $trees trees peaked at $peak kB"
+    status=1
+  }
+fi
+
+exit $status
+) || exit
+
+rm -fr "$tmp"
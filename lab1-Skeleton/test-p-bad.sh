@@ -36,6 +36,10 @@ for bad in \
      ; b' \
   'a;;b' \
   'a&&&b' \
+  '&' \
+  'a & &' \
+  'a & ; b' \
+  'a &>b' \
   'a|||b' \
   '|a' \
   '< a' \
@@ -58,6 +62,17 @@ do
   n=$((n+1))
 done
 
+# A syntax check of every script at once reports an error in each.
+../timetrash -n test*.sh >check.out 2>check.err && {
+  echo >&2 "syntax check unexpectedly succeeded"
+  status=1
+}
+test $(sed -n '/^test[0-9]*\.sh:[0-9]*: /p' check.err | wc -l) -eq $((n-1)) || {
+  echo >&2 "syntax check did not report one error per bad script:"
+  cat >&2 check.err
+  status=1
+}
+
 exit $status
 ) || exit
 
@@ -29,6 +29,10 @@ g<h
 
 # This is a weird example: nobody would ever want to run this.
 a<b>c|d<e>f|g<h>i
+
+sort big >sorted & cat a | wc &
+(x & y)
+wait
 EOF
 
 cat >test.exp <<'EOF'
@@ -76,8 +80,25 @@ cat >test.exp <<'EOF'
     d<e>f \
   |
     g<h>i
+# 9
+    sort big>sorted &
+      cat a \
+    |
+      wc &
+    (
+       x &
+       y
+    ) \
+  ;
+    wait
 EOF
 
+../timetrash -n test.sh >test.out 2>test.err || exit
+test ! -s test.out && test ! -s test.err || {
+  cat test.out test.err
+  exit 1
+}
+
 ../timetrash -p test.sh >test.out 2>test.err || exit
 
 diff -u test.exp test.out || exit